@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bigint.h"
+
+// Times the same workloads whichever way bigint.c was built, so that a
+// default build and a -DBIGINT_CHECKED=1 build can be compared (see
+// readme.txt). The checks cost the same on every call, so they show up on
+// small operands and disappear behind the kernels on large ones
+
+static double secondsSince(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Many cheap calls on one and two block values
+static void benchmarkSmall(unsigned int n) {
+    struct BigInt *x = createBigInt(1);
+    struct BigInt *step = createFromStringBigInt("4294967311");
+    struct BigInt *limit = createFromStringBigInt("18446744073709551557");
+    struct BigInt *product = createBigInt(0);
+    unsigned int count = 0;
+
+    clock_t start = clock();
+    for (unsigned int i = 0; i < n; i++) {
+        addToBigInt(x, x, step);
+        if (compareBigInt(x, limit) > 0) {
+            subtractToBigInt(x, x, limit);
+        }
+        multiplyToBigInt(product, x, step);
+        count += isZeroBigInt(product);
+    }
+    printf("small operands, %u rounds: %.3fs (%u)\n", n, secondsSince(start), count);
+
+    freeBigInt(product);
+    freeBigInt(limit);
+    freeBigInt(step);
+    freeBigInt(x);
+}
+
+// A few calls on values of the given number of blocks
+static void benchmarkLarge(unsigned int numBlocks, unsigned int n) {
+    struct BigInt *x = createBigInt(1);
+    useBlocksBigInt(x, numBlocks);
+    for (unsigned int i = 0; i < numBlocks; i++) {
+        x->blocks[i] = 2654435761u * (i + 1);
+    }
+
+    clock_t start = clock();
+    for (unsigned int i = 0; i < n; i++) {
+        struct BigInt *square = squareBigInt(x);
+        struct BigIntPair *pair = divideBigInt(square, x);
+        freeBigIntPair(pair);
+        freeBigInt(square);
+    }
+    printf("%u block operands, %u squarings and divisions: %.3fs\n", numBlocks, n, secondsSince(start));
+
+    freeBigInt(x);
+}
+
+int main (int argc, char** argv) {
+    printf("BIGINT_CHECKED build: %s\n", isCheckedBuildBigInt() ? "yes" : "no");
+    benchmarkSmall(20000000);
+    benchmarkLarge(1000, 200);
+    benchmarkLarge(100000, 3);
+    return 0;
+}
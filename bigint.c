@@ -5,68 +5,414 @@
 #include <string.h>
 
 #include "bigint.h"
+#include "checked.h"
+
+// Every heap allocation made by this file goes through allocBigInt (scratch
+// space, pairs, strings) or allocMemoryBigInt (BigInts and their blocks), so
+// that we can count them (e.g. to check that division doesn't allocate per
+// digit)
+static unsigned long allocationCount = 0;
+
+static void *allocBigInt(size_t size) {
+    allocationCount++;
+    return malloc(size);
+}
+
+unsigned long getAllocationCountBigInt() {
+    return allocationCount;
+}
+
+// Size-class free lists: requests of up to BIGINT_POOL_MAX_SIZE bytes are
+// rounded up to a power of two, and freed memory is kept on a list per size
+// (up to BIGINT_POOL_MAX_FREE entries, and BIGINT_POOL_MAX_RETAINED bytes over
+// all the lists) to be handed out again without going through malloc. Larger
+// requests go straight to malloc
+#ifndef BIGINT_POOL_MAX_SIZE
+#define BIGINT_POOL_MAX_SIZE 65536
+#endif
+
+#ifndef BIGINT_POOL_MAX_FREE
+#define BIGINT_POOL_MAX_FREE 256
+#endif
+
+#ifndef BIGINT_POOL_MAX_RETAINED
+#define BIGINT_POOL_MAX_RETAINED (1 << 22)
+#endif
+
+#define POOL_MIN_CLASS 4 // 16 bytes, enough to hold the list link
+
+struct PoolEntry {
+    struct PoolEntry *next;
+};
+
+static struct PoolEntry *poolLists[64];
+static unsigned int poolListLengths[64];
+static size_t poolRetainedBytes = 0;
+
+// Smallest k >= POOL_MIN_CLASS with size <= 2^k
+static unsigned int sizeClassPool(size_t size) {
+    unsigned int k = POOL_MIN_CLASS;
+    while (((size_t)1 << k) < size) {
+        k++;
+    }
+    return k;
+}
+
+static void *allocPool(void *state, size_t size) {
+    (void)state;
+    if (size > BIGINT_POOL_MAX_SIZE) {
+        return malloc(size);
+    }
+
+    unsigned int k = sizeClassPool(size);
+    struct PoolEntry *entry = poolLists[k];
+    if (entry == NULL) {
+        return malloc((size_t)1 << k);
+    }
+
+    poolLists[k] = entry->next;
+    poolListLengths[k]--;
+    poolRetainedBytes -= (size_t)1 << k;
+    return entry;
+}
+
+static void releasePool(void *state, void *ptr, size_t size) {
+    (void)state;
+    unsigned int k = sizeClassPool(size);
+    if (size > BIGINT_POOL_MAX_SIZE || poolListLengths[k] >= BIGINT_POOL_MAX_FREE
+        || poolRetainedBytes + ((size_t)1 << k) > BIGINT_POOL_MAX_RETAINED) {
+        free(ptr);
+        return;
+    }
+
+    struct PoolEntry *entry = ptr;
+    entry->next = poolLists[k];
+    poolLists[k] = entry;
+    poolListLengths[k]++;
+    poolRetainedBytes += (size_t)1 << k;
+}
+
+// Returns the memory held on the free lists to malloc
+void trimPoolBigInt() {
+    for (unsigned int k = 0; k < 64; k++) {
+        while (poolLists[k] != NULL) {
+            struct PoolEntry *next = poolLists[k]->next;
+            free(poolLists[k]);
+            poolLists[k] = next;
+        }
+        poolListLengths[k] = 0;
+    }
+    poolRetainedBytes = 0;
+}
+
+static void *allocMalloc(void *state, size_t size) {
+    (void)state;
+    return malloc(size);
+}
+
+static void releaseMalloc(void *state, void *ptr, size_t size) {
+    (void)state;
+    (void)size;
+    free(ptr);
+}
+
+static struct BigIntAllocator mallocAllocator = {allocMalloc, releaseMalloc, NULL};
+static struct BigIntAllocator poolAllocator = {allocPool, releasePool, NULL};
+static struct BigIntAllocator *currentAllocator = &poolAllocator;
+
+struct BigIntAllocator *getMallocAllocatorBigInt() {
+    return &mallocAllocator;
+}
+
+struct BigIntAllocator *getPoolAllocatorBigInt() {
+    return &poolAllocator;
+}
+
+struct BigIntAllocator *getAllocatorBigInt() {
+    return currentAllocator;
+}
+
+// Memory is released through whichever allocator is current, so this counts
+// what has been allocated and not yet released (or reclaimed by resetting an
+// arena), and allocators may only be switched while it's zero
+static size_t liveAllocations = 0;
+
+// Switching allocators is only allowed while nothing is allocated, since
+// otherwise memory could be released to an allocator it didn't come from
+// (arenas handle this themselves, see below)
+void setAllocatorBigInt(struct BigIntAllocator *allocator) {
+    assert(liveAllocations == 0);
+    currentAllocator = allocator;
+}
+
+void *allocMemoryBigInt(size_t size) {
+    allocationCount++;
+    void *out = currentAllocator->alloc(currentAllocator->state, size);
+    if (out != NULL) {
+        liveAllocations++;
+    }
+    return out;
+}
+
+static int releaseToLeftArenaBigInt(void *ptr, size_t size);
+
+void releaseMemoryBigInt(void *ptr, size_t size) {
+    assert(liveAllocations > 0);
+    liveAllocations--;
+    if (releaseToLeftArenaBigInt(ptr, size)) {
+        return;
+    }
+    currentAllocator->release(currentAllocator->state, ptr, size);
+}
+
+// Arenas serve requests of up to BIGINT_ARENA_MAX_SIZE bytes from chunks of
+// at least BIGINT_ARENA_CHUNK_SIZE bytes. Anything larger, and anything
+// released that the arena didn't allocate, is passed on to the allocator that
+// was current when the arena was entered, so big intermediate results still
+// get freed as they go and values from outside the arena can be released.
+// Values freed after the arena is left (and before it's reset) are handed
+// back to it rather than to whatever allocator is current by then
+#ifndef BIGINT_ARENA_MAX_SIZE
+#define BIGINT_ARENA_MAX_SIZE 4096
+#endif
+
+#ifndef BIGINT_ARENA_CHUNK_SIZE
+#define BIGINT_ARENA_CHUNK_SIZE 65536
+#endif
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    unsigned char data[]; // 16-byte aligned after the two fields above
+};
+
+struct BigIntArena {
+    struct BigIntAllocator allocator;
+    struct BigIntAllocator *parent;
+    struct ArenaChunk *chunks; // Newest first, allocation happens in the newest
+    size_t used; // Bytes used in the newest chunk
+    size_t numLive; // Allocations served from the chunks and not yet released
+    struct BigIntArena *nextLeft; // In leftArenas, while left and not yet reset
+};
+
+// Arenas that have been left with allocations still live in their chunks
+static struct BigIntArena *leftArenas = NULL;
+
+// Returns 1 if ptr points into one of the arena's chunks
+static int ownsArena(struct BigIntArena *arena, void *ptr) {
+    for (struct ArenaChunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if ((unsigned char *)ptr >= chunk->data && (unsigned char *)ptr < chunk->data + chunk->size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *allocArena(void *state, size_t size) {
+    struct BigIntArena *arena = state;
+    if (size > BIGINT_ARENA_MAX_SIZE) {
+        return arena->parent->alloc(arena->parent->state, size);
+    }
+
+    size = (size + 15) & ~(size_t)15;
+    if (arena->chunks == NULL || arena->used + size > arena->chunks->size) {
+        size_t chunkSize = arena->chunks == NULL ? BIGINT_ARENA_CHUNK_SIZE : 2 * arena->chunks->size;
+        struct ArenaChunk *chunk = malloc(sizeof(struct ArenaChunk) + chunkSize);
+        chunk->next = arena->chunks;
+        chunk->size = chunkSize;
+        arena->chunks = chunk;
+        arena->used = 0;
+    }
+
+    void *out = arena->chunks->data + arena->used;
+    arena->used += size;
+    arena->numLive++;
+    return out;
+}
+
+static void releaseArena(void *state, void *ptr, size_t size) {
+    struct BigIntArena *arena = state;
+    if (size <= BIGINT_ARENA_MAX_SIZE && ownsArena(arena, ptr)) {
+        arena->numLive--;
+        return;
+    }
+
+    arena->parent->release(arena->parent->state, ptr, size);
+}
+
+// Takes ptr off a left arena's count if it came from one, returns 1 if so
+static int releaseToLeftArenaBigInt(void *ptr, size_t size) {
+    if (size > BIGINT_ARENA_MAX_SIZE) {
+        return 0;
+    }
+    for (struct BigIntArena *arena = leftArenas; arena != NULL; arena = arena->nextLeft) {
+        if (ownsArena(arena, ptr)) {
+            assert(arena->numLive > 0);
+            arena->numLive--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void unlinkLeftArena(struct BigIntArena *arena) {
+    for (struct BigIntArena **link = &leftArenas; *link != NULL; link = &(*link)->nextLeft) {
+        if (*link == arena) {
+            *link = arena->nextLeft;
+            arena->nextLeft = NULL;
+            return;
+        }
+    }
+}
+
+struct BigIntArena *createArenaBigInt() {
+    struct BigIntArena *arena = malloc(sizeof(struct BigIntArena));
+    arena->allocator.alloc = allocArena;
+    arena->allocator.release = releaseArena;
+    arena->allocator.state = arena;
+    arena->parent = NULL;
+    arena->chunks = NULL;
+    arena->used = 0;
+    arena->numLive = 0;
+    arena->nextLeft = NULL;
+    return arena;
+}
+
+// Makes the arena the current allocator, until leaveArenaBigInt
+void enterArenaBigInt(struct BigIntArena *arena) {
+    assert(arena->parent == NULL);
+    unlinkLeftArena(arena);
+    arena->parent = currentAllocator;
+    currentAllocator = &arena->allocator;
+}
+
+void leaveArenaBigInt(struct BigIntArena *arena) {
+    assert(currentAllocator == &arena->allocator);
+    currentAllocator = arena->parent;
+    arena->parent = NULL;
+    if (arena->numLive > 0) {
+        arena->nextLeft = leftArenas;
+        leftArenas = arena;
+    }
+}
+
+// Reclaims everything allocated in the arena. If it needed more than one
+// chunk, they're replaced by a single one of the combined size, so next time
+// the same work fits in one
+void resetArenaBigInt(struct BigIntArena *arena) {
+    assert(arena->parent == NULL);
+    unlinkLeftArena(arena);
+    if (arena->chunks != NULL && arena->chunks->next != NULL) {
+        size_t total = 0;
+        while (arena->chunks != NULL) {
+            struct ArenaChunk *next = arena->chunks->next;
+            total += arena->chunks->size;
+            free(arena->chunks);
+            arena->chunks = next;
+        }
+
+        arena->chunks = malloc(sizeof(struct ArenaChunk) + total);
+        arena->chunks->next = NULL;
+        arena->chunks->size = total;
+    }
+    arena->used = 0;
+
+    // Whatever wasn't released is reclaimed all the same
+    assert(liveAllocations >= arena->numLive);
+    liveAllocations -= arena->numLive;
+    arena->numLive = 0;
+}
+
+void freeArenaBigInt(struct BigIntArena *arena) {
+    resetArenaBigInt(arena);
+    free(arena->chunks);
+    free(arena);
+}
 
 struct BigInt* createBigInt(uint32_t value) {
-    struct BigInt *x = malloc(sizeof(struct BigInt));
+    struct BigInt *x = allocMemoryBigInt(sizeof(struct BigInt));
     x->sign = 1;
-    x->numBlocks = 1;
+    x->numBlocks = BIGINT_INLINE_BLOCKS;
     x->numBlocksUsed = 1;
-    x->blocks = malloc(sizeof(uint32_t));
+    x->blocks = x->inlineBlocks;
     *(x->blocks) = value;
 
     return x;
 }
 
+// Creates a BigInt with the given sign and a magnitude of up to two blocks,
+// which always fits inline
+static struct BigInt *createFromWordBigInt(uint64_t value, int sign) {
+    struct BigInt *x = createBigInt((uint32_t)value);
+    if (value >> 32) {
+        x->blocks[1] = value >> 32;
+        x->numBlocksUsed = 2;
+    }
+    if (value != 0) {
+        x->sign = sign;
+    }
+
+    return x;
+}
+
+// Frees x's blocks unless they're stored inline
+static void freeBlocksBigInt(struct BigInt *x) {
+    if (x->blocks != x->inlineBlocks) {
+        releaseMemoryBigInt(x->blocks, x->numBlocks * sizeof(uint32_t));
+    }
+}
+
+static struct BigInt *fromDecimalChunksBigInt(uint32_t *chunks, unsigned int n);
+
 struct BigInt* createFromStringBigInt(char *str) {
-    struct BigInt *multiplier = createBigInt(1);
-    struct BigInt *base = createBigInt(10);
-    struct BigInt *out = createBigInt(0);
-    struct BigInt *digit = createBigInt(0);
-    struct BigInt *temp;
+    int sign = 1;
+    if (str[0] == '-') {
+        sign = -1;
+        str++;
+    }
 
+    // Split the digits into chunks of 9, least significant first
     size_t len = strlen(str);
-    size_t j;
-    char c;
-    for (size_t i = 0; i < len; i++) {
-        j = len - i - 1;
-        c = str[j];
-        if (j == 0 && c == '-') {
-            out->sign = -1;
-        } else {
-            assert('0' <= c && c <= '9');
-            digit->blocks[0] = c - '0';
-            temp = multiplyBigInt(digit, multiplier);
-            replaceBigInt(&out, addBigInt(out, temp));
-            freeBigInt(temp);
-
-            replaceBigInt(&multiplier, multiplyBigInt(multiplier, base));
+    unsigned int numChunks = len / 9 + 1;
+    uint32_t *chunks = allocBigInt(numChunks * sizeof(uint32_t));
+    for (unsigned int i = 0; i < numChunks; i++) {
+        size_t end = len - 9 * (size_t)i;
+        size_t begin = end > 9 ? end - 9 : 0;
+
+        uint32_t chunk = 0;
+        for (size_t j = begin; j < end; j++) {
+            assert('0' <= str[j] && str[j] <= '9');
+            chunk = 10 * chunk + (str[j] - '0');
         }
+        chunks[i] = chunk;
     }
 
-    freeBigInt(multiplier);
-    freeBigInt(base);
-    freeBigInt(digit);
+    struct BigInt *out = fromDecimalChunksBigInt(chunks, numChunks);
+    if (!isZeroBigInt(out)) {
+        out->sign = sign;
+    }
 
+    free(chunks);
     return out;
 }
 
 struct BigIntPair *createBigIntPair(struct BigInt *x, struct BigInt *y) {
-    struct BigIntPair *out = malloc(sizeof(struct BigIntPair));
+    struct BigIntPair *out = allocBigInt(sizeof(struct BigIntPair));
     out->x = x;
     out->y = y;
     return out;
 }
 
 struct BigIntDigitPair *createBigIntDigitPair(struct BigInt *x, uint32_t y) {
-    struct BigIntDigitPair *out = malloc(sizeof(struct BigIntDigitPair));
+    struct BigIntDigitPair *out = allocBigInt(sizeof(struct BigIntDigitPair));
     out->x = x;
     out->y = y;
     return out;
 }
 
 void freeBigInt(struct BigInt *x) {
-    free(x->blocks);
-    free(x);
+    freeBlocksBigInt(x);
+    releaseMemoryBigInt(x, sizeof(struct BigInt));
 }
 
 void freeBigIntPair(struct BigIntPair *x) {
@@ -96,6 +442,16 @@ void validateBigInt(struct BigInt *x) {
         exit(1);
     }
 
+    if (x->numBlocksUsed > x->numBlocks) {
+        printf("BigInt cannot use more blocks than it has\n");
+        exit(1);
+    }
+
+    if (x->blocks == x->inlineBlocks && x->numBlocks != BIGINT_INLINE_BLOCKS) {
+        printf("BigInt with inline blocks must have exactly BIGINT_INLINE_BLOCKS of them\n");
+        exit(1);
+    }
+
     if (x->numBlocksUsed > 1 && x->blocks[x->numBlocksUsed - 1] == 0) {
         printf("BigInt cannot have trailing zeros (except 0, which has exactly one)\n");
         exit(1);
@@ -107,37 +463,48 @@ void validateBigInt(struct BigInt *x) {
     }
 }
 
+// Whether bigint.c was built with -DBIGINT_CHECKED=1
+int isCheckedBuildBigInt() {
+    return BIGINT_CHECKED;
+}
+
 int isZeroBigInt(struct BigInt *x) {
-    validateBigInt(x);
+    checkBigInt(x);
     return x->numBlocksUsed == 1 && x->blocks[0] == 0;
 }
 
 void growBigInt(struct BigInt *x) {
-    x->numBlocks *= 2;
-    uint32_t *newBlocks = malloc(x->numBlocks * sizeof(uint32_t));
+    uint32_t *newBlocks = allocMemoryBigInt(2 * x->numBlocks * sizeof(uint32_t));
     for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
         newBlocks[i] = x->blocks[i];
     }
-    free(x->blocks);
+    freeBlocksBigInt(x);
     x->blocks = newBlocks;
+    x->numBlocks *= 2;
 }
 
-void useBlocksBigInt(struct BigInt *x, unsigned int numBlocks) {
+// Grows x's capacity to at least numBlocks, keeping its value (unlike
+// useBlocksBigInt, this doesn't change numBlocksUsed)
+static void reserveBlocksBigInt(struct BigInt *x, unsigned int numBlocks) {
     if (x->numBlocks < numBlocks) {
         unsigned int newNumBlocks = x->numBlocks;
         while (newNumBlocks < numBlocks) {
             newNumBlocks *= 2;
         }
 
-        uint32_t *newBlocks = malloc(newNumBlocks * sizeof(uint32_t));
+        uint32_t *newBlocks = allocMemoryBigInt(newNumBlocks * sizeof(uint32_t));
         for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
             newBlocks[i] = x->blocks[i];
         }
 
-        free(x->blocks);
+        freeBlocksBigInt(x);
         x->blocks = newBlocks;
         x->numBlocks = newNumBlocks;
     }
+}
+
+void useBlocksBigInt(struct BigInt *x, unsigned int numBlocks) {
+    reserveBlocksBigInt(x, numBlocks);
 
     while (x->numBlocksUsed < numBlocks) {
         x->blocks[x->numBlocksUsed] = 0;
@@ -145,12 +512,52 @@ void useBlocksBigInt(struct BigInt *x, unsigned int numBlocks) {
     }
 }
 
+// Creates a BigInt equal to zero with room for numBlocks blocks, in one
+// allocation if they fit inline and two otherwise (createBigInt followed by
+// useBlocksBigInt could take one more)
+static struct BigInt *createWithCapacityBigInt(unsigned int numBlocks) {
+    if (numBlocks <= BIGINT_INLINE_BLOCKS) {
+        return createBigInt(0);
+    }
+
+    struct BigInt *out = allocMemoryBigInt(sizeof(struct BigInt));
+    out->sign = 1;
+    out->numBlocks = numBlocks;
+    out->numBlocksUsed = 1;
+    out->blocks = allocMemoryBigInt(out->numBlocks * sizeof(uint32_t));
+    out->blocks[0] = 0;
+
+    return out;
+}
+
+// Like createWithCapacityBigInt, but returns NULL if the memory can't be had
+// (for sizes that come from outside, such as a file)
+static struct BigInt *tryCreateWithCapacityBigInt(unsigned int numBlocks) {
+    if (numBlocks <= BIGINT_INLINE_BLOCKS) {
+        return createBigInt(0);
+    }
+
+    struct BigInt *out = allocMemoryBigInt(sizeof(struct BigInt));
+    if (out == NULL) {
+        return NULL;
+    }
+    out->blocks = allocMemoryBigInt(numBlocks * sizeof(uint32_t));
+    if (out->blocks == NULL) {
+        releaseMemoryBigInt(out, sizeof(struct BigInt));
+        return NULL;
+    }
+    out->sign = 1;
+    out->numBlocks = numBlocks;
+    out->numBlocksUsed = 1;
+    out->blocks[0] = 0;
+
+    return out;
+}
+
 struct BigInt *copyBigInt(struct BigInt *x) {
-    struct BigInt *out = malloc(sizeof(struct BigInt));
+    struct BigInt *out = createWithCapacityBigInt(x->numBlocks);
     out->sign = x->sign;
-    out->numBlocks = x->numBlocks;
     out->numBlocksUsed = x->numBlocksUsed;
-    out->blocks = malloc(x->numBlocks * sizeof(uint32_t));
 
     for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
         out->blocks[i] = x->blocks[i];
@@ -166,31 +573,31 @@ void flipSignBigInt(struct BigInt *x) {
 }
 
 int compareAbsoluteBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
+    checkBigInt(x);
+    checkBigInt(y);
 
     unsigned int xBlocks = x->numBlocksUsed;
     unsigned int yBlocks = y->numBlocksUsed;
-    unsigned int n = xBlocks > yBlocks ? xBlocks : yBlocks;
 
-    int currComp = 0;
-    for (unsigned int i = 0; i < n; i++) {
-        if (yBlocks <= i || (xBlocks > i && x->blocks[i] > y->blocks[i])) {
-            // Most signficant block of x (until now) is bigger than that of y
-            currComp = 1;
-        } else if (xBlocks <= i || (yBlocks > i && y->blocks[i] > x->blocks[i])) {
-            // Same as previous case, but with x and y swapped (i.e. y > x)
-            currComp = -1;
+    // Neither has leading zero blocks, so the longer one is bigger
+    if (xBlocks != yBlocks) {
+        return xBlocks > yBlocks ? 1 : -1;
+    }
+
+    // Otherwise the most significant differing block decides
+    for (unsigned int i = xBlocks; i > 0; i--) {
+        if (x->blocks[i - 1] != y->blocks[i - 1]) {
+            return x->blocks[i - 1] > y->blocks[i - 1] ? 1 : -1;
         }
     }
 
-    return currComp;
+    return 0;
 }
 
 
 int compareBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
+    checkBigInt(x);
+    checkBigInt(y);
 
     if (x->sign > y->sign) {
         return 1;
@@ -200,477 +607,3114 @@ int compareBigInt(struct BigInt *x, struct BigInt *y) {
         return -1;
     }
 
+    if (x->numBlocksUsed == 1 && y->numBlocksUsed == 1) {
+        int cmp = (x->blocks[0] > y->blocks[0]) - (x->blocks[0] < y->blocks[0]);
+        return x->sign * cmp;
+    }
+
     // If both x and y are negative, we want to flip comparison of their absolute values
     // (at this point, we know their signs are equal)
     return x->sign * compareAbsoluteBigInt(x, y);
 }
 
-struct BigInt *addBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
-
-    struct BigInt *out = createBigInt(0);
-
-    // A subtraction problem (opposite signs)
-    if (x->sign + y->sign == 0) {
-        int cmp = compareAbsoluteBigInt(x, y);
-        if (cmp == 0) {
-            return out;
-        }
-
-        if (cmp < 0) {
-            // Ensure that x has larger absolute value
-            struct BigInt *temp = x;
-            x = y;
-            y = temp;
-        }
-
-        unsigned int xBlocks = x->numBlocksUsed;
-        unsigned int yBlocks = y->numBlocksUsed;
-        unsigned int n = xBlocks > yBlocks ? xBlocks : yBlocks;
-
-        uint32_t newBlock;
-        unsigned int borrow = 0;
-        for (unsigned int i = 0; i < n; i++) {
-            if (xBlocks <= i) {
-                newBlock = y->blocks[i] - borrow;
-                borrow = 0;
-            } else if (yBlocks <= i) {
-                newBlock = x->blocks[i] - borrow;
-                borrow = 0;
-            } else {
-                newBlock = x->blocks[i] - y->blocks[i] - borrow;
-                if (newBlock > x->blocks[i]) {
-                    borrow = 1;
-                } else {
-                    borrow = 0;
-                }
-            }
+// With BIGINT_WIDE_BLOCKS (on by default where the compiler has unsigned
+// __int128), the innermost add, subtract, multiply and division loops read
+// and write blocks in pairs, as 64-bit words with 128-bit products, which
+// halves the number of steps they take. Blocks are still 32 bits everywhere
+// else, so the struct, the binary format and the API don't change.
+// Build with -DBIGINT_WIDE_BLOCKS=0 to use only 32-bit steps
+#ifndef BIGINT_WIDE_BLOCKS
+#ifdef __SIZEOF_INT128__
+#define BIGINT_WIDE_BLOCKS 1
+#else
+#define BIGINT_WIDE_BLOCKS 0
+#endif
+#endif
+
+#if BIGINT_WIDE_BLOCKS
+// Blocks x[0] and x[1] as one 64-bit word
+static uint64_t loadPairBlocks(uint32_t *x) {
+    return x[0] | (uint64_t)x[1] << 32;
+}
 
-            if (newBlock != 0) {
-                useBlocksBigInt(out, i + 1);
-                out->blocks[i] = newBlock;
-            }
-        }
+static void storePairBlocks(uint32_t *x, uint64_t value) {
+    x[0] = (uint32_t)value;
+    x[1] = value >> 32;
+}
+#endif
+
+// Multiplication crossover points, in blocks of the smaller operand.
+// Below KARATSUBA_THRESHOLD we use the schoolbook kernel, below
+// TOOM3_THRESHOLD we use Karatsuba, below NTT_THRESHOLD Toom-3, and above
+// that NTT (as long as the product is small enough for it).
+// Override at compile time with e.g. -DKARATSUBA_THRESHOLD=48
+#ifndef KARATSUBA_THRESHOLD
+#define KARATSUBA_THRESHOLD 32
+#endif
+
+#ifndef TOOM3_THRESHOLD
+#define TOOM3_THRESHOLD 128
+#endif
+
+// Wide blocks make Toom-3 about twice as fast but leave NTT as it is, which
+// moves the NTT crossover a long way up
+#ifndef NTT_THRESHOLD
+#if BIGINT_WIDE_BLOCKS
+#define NTT_THRESHOLD 49152
+#else
+#define NTT_THRESHOLD 4096
+#endif
+#endif
+
+// Squaring has its own crossover points, since the schoolbook and NTT
+// kernels both get cheaper when the operands are the same
+#ifndef KARATSUBA_SQUARE_THRESHOLD
+#define KARATSUBA_SQUARE_THRESHOLD 48
+#endif
+
+#ifndef TOOM3_SQUARE_THRESHOLD
+#define TOOM3_SQUARE_THRESHOLD 160
+#endif
+
+#ifndef NTT_SQUARE_THRESHOLD
+#if BIGINT_WIDE_BLOCKS
+#define NTT_SQUARE_THRESHOLD 32768
+#else
+#define NTT_SQUARE_THRESHOLD 3072
+#endif
+#endif
+
+// Karatsuba recurses on (n/2 + 1)-block halves, which only shrinks for n >= 4
+#if KARATSUBA_THRESHOLD < 4 || KARATSUBA_SQUARE_THRESHOLD < 4
+#error "KARATSUBA_THRESHOLD and KARATSUBA_SQUARE_THRESHOLD must be at least 4"
+#endif
+
+// The functions below work directly on arrays of blocks (least significant
+// block first) rather than on BigInts, so that the recursive multiplication
+// algorithms don't have to allocate a BigInt for every intermediate value.
+// Unless otherwise noted, lengths don't have to be normalized (i.e. arrays
+// may have leading zero blocks).
+
+// Removes leading zero blocks from length (but always keeps at least one block)
+static unsigned int trimLengthBlocks(uint32_t *x, unsigned int n) {
+    while (n > 1 && x[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
 
-        out->sign = x->sign;
+static int compareBlocks(uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    xn = trimLengthBlocks(x, xn);
+    yn = trimLengthBlocks(y, yn);
 
-        return out;
+    if (xn != yn) {
+        return xn > yn ? 1 : -1;
     }
-    
-    unsigned int xBlocks = x->numBlocksUsed;
-    unsigned int yBlocks = y->numBlocksUsed;
-    unsigned int n = xBlocks > yBlocks ? xBlocks : yBlocks;
 
-    unsigned int carry = 0;
-    for (unsigned int i = 0; i < n; i++) {
-        if (out->numBlocks <= i) {
-            growBigInt(out);
+    for (unsigned int i = xn; i > 0; i--) {
+        if (x[i - 1] != y[i - 1]) {
+            return x[i - 1] > y[i - 1] ? 1 : -1;
         }
+    }
 
-        if (i == out->numBlocksUsed) {
-            out->numBlocksUsed += 1;
-        }
+    return 0;
+}
 
-        if (xBlocks <= i) {
-            out->blocks[i] = y->blocks[i] + carry;
-            carry = 0;
-        } else if (yBlocks <= i) {
-            out->blocks[i] = x->blocks[i] + carry;
-            carry = 0;
-        } else {
-            out->blocks[i] = x->blocks[i] + y->blocks[i] + carry;
-            if (out->blocks[i] < x->blocks[i]) {
-                carry = 1;
-            } else {
-                carry = 0;
-            }
-        }
+// out = x + y, requires xn >= yn, out must have room for xn blocks (may alias x or y)
+// Returns the carry out of the most significant block
+static uint32_t addBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    uint64_t sum;
+    uint32_t carry = 0;
+    unsigned int i = 0;
+
+#if BIGINT_WIDE_BLOCKS
+    for (; i + 1 < yn; i += 2) {
+        uint64_t a = loadPairBlocks(x + i);
+        uint64_t wideSum = a + loadPairBlocks(y + i);
+        uint32_t nextCarry = wideSum < a;
+        wideSum += carry;
+        nextCarry += wideSum < carry;
+        storePairBlocks(out + i, wideSum);
+        carry = nextCarry;
     }
+#endif
 
-    if (carry) {
-        if (out->numBlocks == out->numBlocksUsed) {
-            growBigInt(out);
-        }
-        out->numBlocksUsed += 1;
-        out->blocks[n] = 1;
+    for (; i < yn; i++) {
+        sum = (uint64_t)x[i] + y[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> 32;
     }
-    
-    out->sign = x->sign;
-    return out;
-}
 
-struct BigInt *subtractBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
-
-    struct BigInt *yNeg = copyBigInt(y);
-    flipSignBigInt(yNeg);
-    struct BigInt *out = addBigInt(x, yNeg);
-    freeBigInt(yNeg);
+    for (; i < xn; i++) {
+        sum = (uint64_t)x[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
 
-    return out;
+    return carry;
 }
 
-struct BigInt *multiplyBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
+// out = x - y, requires xn >= yn, out must have room for xn blocks (may alias x or y)
+// Returns the borrow out of the most significant block (nonzero iff x < y)
+static uint32_t subtractBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    uint64_t diff;
+    uint32_t borrow = 0;
+    unsigned int i = 0;
+
+#if BIGINT_WIDE_BLOCKS
+    for (; i + 1 < yn; i += 2) {
+        uint64_t a = loadPairBlocks(x + i);
+        uint64_t b = loadPairBlocks(y + i);
+        uint64_t wideDiff = a - b;
+        uint32_t nextBorrow = a < b;
+        nextBorrow += wideDiff < borrow;
+        wideDiff -= borrow;
+        storePairBlocks(out + i, wideDiff);
+        borrow = nextBorrow;
+    }
+#endif
 
-    struct BigInt *out = createBigInt(0);
+    for (; i < yn; i++) {
+        diff = (uint64_t)x[i] - y[i] - borrow;
+        out[i] = (uint32_t)diff;
+        borrow = (diff >> 32) & 1;
+    }
 
-    if (isZeroBigInt(x) || isZeroBigInt(y)) {
-        return out;
+    for (; i < xn; i++) {
+        diff = (uint64_t)x[i] - borrow;
+        out[i] = (uint32_t)diff;
+        borrow = (diff >> 32) & 1;
     }
 
-    unsigned int xBlocks = x->numBlocksUsed;
-    unsigned int yBlocks = y->numBlocksUsed;
+    return borrow;
+}
 
-    uint32_t carry;
-    uint64_t result;
-    for (unsigned int i = 0; i < xBlocks; i++) {
-        carry = 0;
-        for (unsigned int j = 0; j < yBlocks; j++) {
-            useBlocksBigInt(out, i + j + 1);
+// x += y, where x has xn blocks and the sum is known to fit in them
+static void addInPlaceBlocks(uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    yn = trimLengthBlocks(y, yn);
+    assert(xn >= yn);
+    uint32_t carry = addBlocks(x, x, xn, y, yn);
+    assert(carry == 0);
+}
 
-            result = (uint64_t)x->blocks[i] * y->blocks[j];
-            out->blocks[i + j] += (uint32_t)result + carry;
-            carry = result >> 32;
+// x -= y, where x has xn blocks and x >= y
+static void subtractInPlaceBlocks(uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    yn = trimLengthBlocks(y, yn);
+    assert(xn >= yn);
+    uint32_t borrow = subtractBlocks(x, x, xn, y, yn);
+    assert(borrow == 0);
+}
 
-            if (out->blocks[i + j] < (uint32_t)result) {
-                // Overflow during addition
-                carry++;
-            }
-        }
-        if (carry) {
-            if (i + yBlocks == out->numBlocksUsed) {
-                if (out->numBlocks == out->numBlocksUsed) {
-                    growBigInt(out);
-                }
-                out->numBlocksUsed++;
-            }
-            out->blocks[i + yBlocks] = carry;
+// Adds two signed numbers (sign 1 or -1) with out = x + y, returns length of out
+// out must have room for max(xn, yn) + 1 blocks, and may alias x or y
+static unsigned int addSignedBlocks(
+    uint32_t *out, int *outSign,
+    uint32_t *x, unsigned int xn, int xSign,
+    uint32_t *y, unsigned int yn, int ySign
+) {
+    xn = trimLengthBlocks(x, xn);
+    yn = trimLengthBlocks(y, yn);
+
+    if (xSign == ySign) {
+        if (xn < yn) {
+            uint32_t *temp = x; x = y; y = temp;
+            unsigned int tempN = xn; xn = yn; yn = tempN;
         }
+        out[xn] = addBlocks(out, x, xn, y, yn);
+        *outSign = xSign;
+        return trimLengthBlocks(out, xn + 1);
     }
-    
-    out->sign = x->sign * y->sign;
-    return out;
-}
 
-struct BigInt *shiftRightBigInt(struct BigInt *x, unsigned int places) {
-    validateBigInt(x);
+    if (compareBlocks(x, xn, y, yn) < 0) {
+        uint32_t *temp = x; x = y; y = temp;
+        unsigned int tempN = xn; xn = yn; yn = tempN;
+        xSign = ySign;
+    }
+    subtractBlocks(out, x, xn, y, yn);
+    unsigned int n = trimLengthBlocks(out, xn);
+    *outSign = (n == 1 && out[0] == 0) ? 1 : xSign;
+    return n;
+}
 
-    unsigned int xBlocks = x->numBlocksUsed;
-    assert(xBlocks > places);
-    unsigned int newNumBlocks = xBlocks - places;
-    
-    struct BigInt *out = createBigInt(0);
-    useBlocksBigInt(out, newNumBlocks);
+// Exact division of x by a single block (no remainder), done in place
+static void divideExactByDigitBlocks(uint32_t *x, unsigned int n, uint32_t y) {
+    uint64_t rem = 0;
+    for (unsigned int i = n; i > 0; i--) {
+        uint64_t cur = (rem << 32) | x[i - 1];
+        x[i - 1] = cur / y;
+        rem = cur % y;
+    }
+    assert(rem == 0);
+}
 
-    for (unsigned int i = 0; i < newNumBlocks; i++) {
-        out->blocks[i] = x->blocks[i + places];
+// x >>= 1, in place
+static void halveBlocks(uint32_t *x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        x[i] = (x[i] >> 1) | (i + 1 < n ? x[i + 1] << 31 : 0);
     }
+}
 
-    out->sign = x->sign;
-    return out;
+static unsigned int leadingZerosBlock(uint32_t x) {
+    unsigned int n = 0;
+    while (n < 32 && !(x & ((uint32_t)1 << (31 - n)))) {
+        n++;
+    }
+    return n;
 }
 
-struct BigInt *shiftLeftBigInt(struct BigInt *x, unsigned int places) {
-    validateBigInt(x);
+// Reciprocal of a normalized block d (top bit set), floor((2^64 - 1) / d) - 2^32
+// With it, dividing a two block number by d takes two multiplications instead
+// of a hardware division (Moller and Granlund, "Improved division by
+// invariant integers")
+static uint32_t reciprocalBlock(uint32_t d) {
+    return (uint32_t)(UINT64_MAX / d - ((uint64_t)1 << 32));
+}
 
-    struct BigInt *out = createBigInt(0);
+// Divides (u1 * 2^32 + u0) by the normalized block d, given its reciprocal v
+// Requires u1 < d, returns the quotient and stores the remainder in r
+static uint32_t divideByReciprocalBlock(uint32_t u1, uint32_t u0, uint32_t d, uint32_t v, uint32_t *r) {
+    uint64_t q = (uint64_t)v * u1 + (((uint64_t)u1 << 32) | u0);
+    uint32_t q1 = (uint32_t)(q >> 32) + 1;
+    uint32_t rem = u0 - q1 * d;
 
-    if (isZeroBigInt(x)) {
-        return out;
+    if (rem > (uint32_t)q) {
+        q1--;
+        rem += d;
     }
-
-    useBlocksBigInt(out, x->numBlocksUsed + places);
-
-    for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
-        out->blocks[i + places] = x->blocks[i];
+    if (rem >= d) {
+        q1++;
+        rem -= d;
     }
 
-    out->sign = x->sign;
-    return out;
+    *r = rem;
+    return q1;
 }
 
-struct BigIntDigitPair *divideByDigitBigInt(struct BigInt *x, uint32_t y) {
-    validateBigInt(x);
-    assert(y != 0);
-
-    if (x->numBlocksUsed == 1) {
-        if (x->blocks[0] == 0) {
-            return createBigIntDigitPair(createBigInt(0), 0);
-        } else if (x->blocks[0] == y) {
-            struct BigInt *q = createBigInt(1);
-            q->sign = x->sign;
-            return createBigIntDigitPair(q, 0);
-        } else if (x->blocks[0] < y) {
-            if (x->sign == 1) {
-                return createBigIntDigitPair(createBigInt(0), x->blocks[0]);
-            } else {
-                struct BigInt *q = createBigInt(1);
-                q->sign = -1;
-                return createBigIntDigitPair(q, y - x->blocks[0]);
-            }
+// q = x / y for a single block y, returns the remainder
+// q must have room for n blocks (may alias x)
+// The dividend is normalized on the fly (shifted so the top bit of y is set),
+// which leaves the quotient unchanged and the remainder shifted
+static uint32_t divideByDigitBlocks(uint32_t *q, uint32_t *x, unsigned int n, uint32_t y) {
+    unsigned int s = leadingZerosBlock(y);
+    uint32_t d = y << s;
+    uint32_t v = reciprocalBlock(d);
+
+    uint32_t rem = s == 0 ? 0 : x[n - 1] >> (32 - s);
+    for (unsigned int i = n; i > 0; i--) {
+        uint32_t u0 = x[i - 1] << s;
+        if (s != 0 && i > 1) {
+            u0 |= x[i - 2] >> (32 - s);
         }
+        q[i - 1] = divideByReciprocalBlock(rem, u0, d, v, &rem);
     }
+    return rem >> s;
+}
 
-    unsigned int xBlocks = x->numBlocksUsed;
-    unsigned int n = 1;
-    unsigned int m = xBlocks - 1;
-
-    struct BigInt *q = createBigInt(0);
-    struct BigInt *u = shiftRightBigInt(x, m);
-    u->sign = 1; // We always divide positive numbers, then set sign later
-    struct BigInt *w;
-    struct BigInt *r = createBigInt(0);
+// x = x * m + a in place, x must have room for n + 1 blocks
+// Returns the new length
+static unsigned int multiplyAddDigitBlocks(uint32_t *x, unsigned int n, uint32_t m, uint32_t a) {
+    uint64_t carry = a;
+    unsigned int i = 0;
+
+#if BIGINT_WIDE_BLOCKS
+    for (; i + 1 < n; i += 2) {
+        unsigned __int128 cur = (unsigned __int128)m * loadPairBlocks(x + i) + carry;
+        storePairBlocks(x + i, (uint64_t)cur);
+        carry = (uint64_t)(cur >> 64);
+    }
+#endif
 
-    struct BigInt *temp = createBigInt(0);
-    struct BigInt *yBig = createBigInt(y);
+    for (; i < n; i++) {
+        uint64_t cur = (uint64_t)x[i] * m + carry;
+        x[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
 
-    uint32_t tempBlock;
+    if (carry != 0) {
+        x[n] = (uint32_t)carry;
+        n++;
+    }
+    return trimLengthBlocks(x, n);
+}
 
-    uint32_t un;
-    uint32_t un1;
+// Adds one to x in place, x must have room for n + 1 blocks
+// Returns the new length
+static unsigned int incrementBlocks(uint32_t *x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        if (++x[i] != 0) {
+            return n;
+        }
+    }
+    x[n] = 1;
+    return n + 1;
+}
 
-    unsigned int j;
-    for (unsigned int i = 0; i < m + 1; i++) {
-        j = m - i;
+// out = x * y via schoolbook multiplication, out must have room for xn + yn
+// blocks and must not alias x or y
+static void schoolbookMultiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    for (unsigned int i = 0; i < xn + yn; i++) {
+        out[i] = 0;
+    }
 
-        if (u->numBlocksUsed < n) {
-            un = 0;
-            un1 = 0;
-        } else if (u->numBlocksUsed == n) {
-            un = 0;
-            un1 = u->blocks[n - 1];
-        } else {
-            un = u->blocks[n];
-            un1 = u->blocks[n - 1];
+#if BIGINT_WIDE_BLOCKS
+    // Same loops over 64-bit words. An odd x or y has a last word with one
+    // block, and since the product fits in xn + yn blocks, the only stores
+    // that can fall past the end are of zero
+    unsigned int xw = (xn + 1) / 2;
+    unsigned int yFull = yn / 2;
+    for (unsigned int i = 0; i < xw; i++) {
+        uint64_t xi = 2 * i + 1 < xn ? loadPairBlocks(x + 2 * i) : x[2 * i];
+        if (xi == 0) {
+            continue;
         }
 
-//        printf("un: %u\n", un);
-//        printf("un1: %u\n", un1);
-//        printf("y: %u\n", y);
+        uint32_t *row = out + 2 * i;
+        uint64_t carry = 0;
+        unsigned __int128 result;
+        for (unsigned int j = 0; j < yFull; j++) {
+            // Can't overflow: (2^64 - 1)^2 + 2 * (2^64 - 1) = 2^128 - 1
+            result = (unsigned __int128)xi * loadPairBlocks(y + 2 * j) + loadPairBlocks(row + 2 * j) + carry;
+            storePairBlocks(row + 2 * j, (uint64_t)result);
+            carry = result >> 64;
+        }
+        if (yn % 2 == 1) {
+            result = (unsigned __int128)xi * y[yn - 1] + loadPairBlocks(row + 2 * yFull) + carry;
+            storePairBlocks(row + 2 * yFull, (uint64_t)result);
+            carry = result >> 64;
+        }
 
-        if (un == y) {
-            tempBlock = UINT32_MAX;
+        // The carry goes in blocks 2 (i + yw) and up, of which only those
+        // below xn + yn exist
+        unsigned int top = 2 * i + 2 * ((yn + 1) / 2);
+        if (top + 1 < xn + yn) {
+            storePairBlocks(out + top, carry);
+        } else if (top < xn + yn) {
+            out[top] = (uint32_t)carry;
+            assert(carry >> 32 == 0);
         } else {
-            tempBlock = (((uint64_t)un << 32) + un1) / y;
+            assert(carry == 0);
         }
+    }
+#else
+    uint64_t result;
+    uint32_t carry;
+    for (unsigned int i = 0; i < xn; i++) {
+        if (x[i] == 0) {
+            continue;
+        }
+
+        carry = 0;
+        for (unsigned int j = 0; j < yn; j++) {
+            // Can't overflow: (2^32 - 1)^2 + 2 * (2^32 - 1) = 2^64 - 1
+            result = (uint64_t)x[i] * y[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)result;
+            carry = result >> 32;
+        }
+        out[i + yn] = carry;
+    }
+#endif
+}
+
+// out = x^2 via schoolbook squaring, out must have room for 2n blocks and
+// must not alias x
+// Each cross product x[i] x[j] with i < j is computed once and then doubled,
+// so this takes roughly half the block multiplications of the general kernel
+static void schoolbookSquareBlocks(uint32_t *out, uint32_t *x, unsigned int n) {
+    for (unsigned int i = 0; i < 2 * n; i++) {
+        out[i] = 0;
+    }
+
+#if BIGINT_WIDE_BLOCKS
+    // Same steps over 64-bit words, where for odd n the last word has one block
+    unsigned int nw = (n + 1) / 2;
+    for (unsigned int i = 0; i + 1 < nw; i++) {
+        uint64_t xi = loadPairBlocks(x + 2 * i);
+        if (xi == 0) {
+            continue;
+        }
+
+        uint32_t *row = out + 2 * i;
+        uint64_t carry = 0;
+        unsigned __int128 result;
+        for (unsigned int j = i + 1; j < nw; j++) {
+            uint64_t xj = 2 * j + 1 < n ? loadPairBlocks(x + 2 * j) : x[2 * j];
+            result = (unsigned __int128)xi * xj + loadPairBlocks(row + 2 * j) + carry;
+            storePairBlocks(row + 2 * j, (uint64_t)result);
+            carry = result >> 64;
+        }
+        storePairBlocks(row + 2 * nw, carry);
+    }
+
+    // Double the cross products, and add in the squares along the diagonal
+    addBlocks(out, out, 2 * n, out, 2 * n);
+
+    uint64_t carry = 0;
+    for (unsigned int i = 0; i < nw; i++) {
+        uint64_t xi = 2 * i + 1 < n ? loadPairBlocks(x + 2 * i) : x[2 * i];
+        unsigned __int128 square = (unsigned __int128)xi * xi;
+
+        unsigned __int128 lo = (unsigned __int128)loadPairBlocks(out + 4 * i) + (uint64_t)square + carry;
+        storePairBlocks(out + 4 * i, (uint64_t)lo);
+
+        // For odd n, the top word of the last square is zero and has no room
+        if (4 * i + 3 < 2 * n) {
+            unsigned __int128 hi = (unsigned __int128)loadPairBlocks(out + 4 * i + 2) + (uint64_t)(square >> 64) + (uint64_t)(lo >> 64);
+            storePairBlocks(out + 4 * i + 2, (uint64_t)hi);
+            carry = hi >> 64;
+        } else {
+            assert((square >> 64) == 0 && (lo >> 64) == 0);
+            carry = 0;
+        }
+    }
+    assert(carry == 0);
+#else
+    uint64_t result;
+    uint32_t carry;
+    for (unsigned int i = 0; i < n; i++) {
+        if (x[i] == 0) {
+            continue;
+        }
+
+        carry = 0;
+        for (unsigned int j = i + 1; j < n; j++) {
+            result = (uint64_t)x[i] * x[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)result;
+            carry = result >> 32;
+        }
+        out[i + n] = carry;
+    }
+
+    // Double the cross products
+    addBlocks(out, out, 2 * n, out, 2 * n);
+
+    // Add in the squares along the diagonal
+    uint64_t lo;
+    uint64_t hi;
+    carry = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        result = (uint64_t)x[i] * x[i];
+        lo = (uint64_t)out[2 * i] + (uint32_t)result + carry;
+        out[2 * i] = (uint32_t)lo;
+        hi = (uint64_t)out[2 * i + 1] + (result >> 32) + (lo >> 32);
+        out[2 * i + 1] = (uint32_t)hi;
+        carry = hi >> 32;
+    }
+    assert(carry == 0);
+#endif
+}
+
+static void multiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn);
+
+// Karatsuba multiplication, requires (xn + 1) / 2 < yn <= xn
+// Splits x = x1 * B^h + x0 and y = y1 * B^h + y0, and uses
+// (x0 + x1)(y0 + y1) - x0 y0 - x1 y1 for the middle term, so only three
+// half-size multiplications are needed
+// If x and y are the same array, all three are squarings
+static void karatsubaMultiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    unsigned int h = (xn + 1) / 2;
+    assert(yn > h && yn <= xn);
+    int square = x == y && xn == yn;
+
+    uint32_t *x0 = x;
+    uint32_t *x1 = x + h;
+    uint32_t *y0 = y;
+    uint32_t *y1 = y + h;
+    unsigned int x1n = xn - h;
+    unsigned int y1n = yn - h;
+
+    // z0 = x0 * y0 and z2 = x1 * y1 go straight into their final positions
+    multiplyBlocks(out, x0, h, y0, h);
+    multiplyBlocks(out + 2 * h, x1, x1n, y1, y1n);
+
+    uint32_t *scratch = allocBigInt((4 * h + 4) * sizeof(uint32_t));
+    uint32_t *sx = scratch;
+    uint32_t *sy = scratch + h + 1;
+    uint32_t *z1 = scratch + 2 * h + 2;
+
+    sx[h] = addBlocks(sx, x0, h, x1, x1n);
+    if (square) {
+        sy = sx;
+    } else {
+        sy[h] = addBlocks(sy, y0, h, y1, y1n);
+    }
+    multiplyBlocks(z1, sx, h + 1, sy, h + 1);
+
+    subtractInPlaceBlocks(z1, 2 * h + 2, out, 2 * h);
+    subtractInPlaceBlocks(z1, 2 * h + 2, out + 2 * h, x1n + y1n);
+    addInPlaceBlocks(out + h, xn + yn - h, z1, 2 * h + 2);
+
+    free(scratch);
+}
+
+// Toom-3 multiplication, requires 2 * k < yn <= xn where k = (xn + 2) / 3
+// Splits x and y into three k-block pieces, treats them as quadratic
+// polynomials in B^k, evaluates at 0, 1, -1, -2 and infinity, multiplies
+// pointwise (five multiplications of size k instead of nine) and
+// interpolates using Bodrato's sequence
+// If x and y are the same array, the pointwise products are all squarings
+static void toom3MultiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    unsigned int k = (xn + 2) / 3;
+    assert(yn > 2 * k && yn <= xn);
+    int square = x == y && xn == yn;
+
+    uint32_t *x0 = x;
+    uint32_t *x1 = x + k;
+    uint32_t *x2 = x + 2 * k;
+    uint32_t *y0 = y;
+    uint32_t *y1 = y + k;
+    uint32_t *y2 = y + 2 * k;
+    unsigned int x2n = xn - 2 * k;
+    unsigned int y2n = yn - 2 * k;
+
+    // Evaluations have at most k + 1 blocks, products at most 2k + 2 blocks,
+    // and interpolation can need one more block on top of that
+    unsigned int e = k + 2;
+    unsigned int p = 2 * k + 5;
+    uint32_t *scratch = allocBigInt((4 * e + 3 * p) * sizeof(uint32_t));
+    uint32_t *px = scratch;
+    uint32_t *py = scratch + e;
+    uint32_t *mx = scratch + 2 * e;
+    uint32_t *my = scratch + 3 * e;
+    uint32_t *r1 = scratch + 4 * e;
+    uint32_t *rm1 = r1 + p;
+    uint32_t *rm2 = rm1 + p;
+    unsigned int pxn, pyn, mxn, myn, r1n, rm1n, rm2n;
+    int pxSign, pySign, mxSign, mySign, r1Sign, rm1Sign, rm2Sign;
+
+    // r0 = x0 y0 and rinf = x2 y2 go straight into their final positions
+    multiplyBlocks(out, x0, k, y0, k);
+    for (unsigned int i = 2 * k; i < 4 * k; i++) {
+        out[i] = 0;
+    }
+    multiplyBlocks(out + 4 * k, x2, x2n, y2, y2n);
+    uint32_t *r0 = out;
+    unsigned int r0n = 2 * k;
+    uint32_t *rinf = out + 4 * k;
+    unsigned int rinfn = x2n + y2n;
+
+    // px = x0 + x2, then x(1) = px + x1 and x(-1) = px - x1
+    pxn = addSignedBlocks(px, &pxSign, x0, k, 1, x2, x2n, 1);
+    mxn = addSignedBlocks(mx, &mxSign, px, pxn, 1, x1, k, -1);
+    pxn = addSignedBlocks(px, &pxSign, px, pxn, 1, x1, k, 1);
+    if (square) {
+        py = px; pyn = pxn; pySign = pxSign;
+        my = mx; myn = mxn; mySign = mxSign;
+    } else {
+        pyn = addSignedBlocks(py, &pySign, y0, k, 1, y2, y2n, 1);
+        myn = addSignedBlocks(my, &mySign, py, pyn, 1, y1, k, -1);
+        pyn = addSignedBlocks(py, &pySign, py, pyn, 1, y1, k, 1);
+    }
+
+    // r1 = x(1) y(1), rm1 = x(-1) y(-1)
+    multiplyBlocks(r1, px, pxn, py, pyn);
+    r1n = trimLengthBlocks(r1, pxn + pyn);
+    r1Sign = 1;
+    multiplyBlocks(rm1, mx, mxn, my, myn);
+    rm1n = trimLengthBlocks(rm1, mxn + myn);
+    rm1Sign = mxSign * mySign;
+
+    // x(-2) = 2 (x(-1) + x2) - x0, reusing px and py
+    pxn = addSignedBlocks(px, &pxSign, mx, mxn, mxSign, x2, x2n, 1);
+    px[pxn] = addBlocks(px, px, pxn, px, pxn);
+    pxn = addSignedBlocks(px, &pxSign, px, pxn + 1, pxSign, x0, k, -1);
+    if (square) {
+        pyn = pxn; pySign = pxSign;
+    } else {
+        pyn = addSignedBlocks(py, &pySign, my, myn, mySign, y2, y2n, 1);
+        py[pyn] = addBlocks(py, py, pyn, py, pyn);
+        pyn = addSignedBlocks(py, &pySign, py, pyn + 1, pySign, y0, k, -1);
+    }
+
+    multiplyBlocks(rm2, px, pxn, py, pyn);
+    rm2n = trimLengthBlocks(rm2, pxn + pyn);
+    rm2Sign = pxSign * pySign;
+
+    // Interpolation (all divisions are exact):
+    // r3 = (rm2 - r1) / 3           (stored in rm2)
+    // r1 = (r1 - rm1) / 2
+    // r2 = rm1 - r0                 (stored in rm1)
+    // r3 = (r2 - r3) / 2 + 2 rinf
+    // r2 = r2 + r1 - rinf
+    // r1 = r1 - r3
+    rm2n = addSignedBlocks(rm2, &rm2Sign, rm2, rm2n, rm2Sign, r1, r1n, -1);
+    divideExactByDigitBlocks(rm2, rm2n, 3);
+    rm2n = trimLengthBlocks(rm2, rm2n);
+
+    r1n = addSignedBlocks(r1, &r1Sign, r1, r1n, r1Sign, rm1, rm1n, -rm1Sign);
+    halveBlocks(r1, r1n);
+    r1n = trimLengthBlocks(r1, r1n);
+
+    rm1n = addSignedBlocks(rm1, &rm1Sign, rm1, rm1n, rm1Sign, r0, r0n, -1);
+
+    rm2n = addSignedBlocks(rm2, &rm2Sign, rm1, rm1n, rm1Sign, rm2, rm2n, -rm2Sign);
+    halveBlocks(rm2, rm2n);
+    rm2n = trimLengthBlocks(rm2, rm2n);
+    rm2n = addSignedBlocks(rm2, &rm2Sign, rm2, rm2n, rm2Sign, rinf, rinfn, 1);
+    rm2n = addSignedBlocks(rm2, &rm2Sign, rm2, rm2n, rm2Sign, rinf, rinfn, 1);
+
+    rm1n = addSignedBlocks(rm1, &rm1Sign, rm1, rm1n, rm1Sign, r1, r1n, r1Sign);
+    rm1n = addSignedBlocks(rm1, &rm1Sign, rm1, rm1n, rm1Sign, rinf, rinfn, -1);
+
+    r1n = addSignedBlocks(r1, &r1Sign, r1, r1n, r1Sign, rm2, rm2n, -rm2Sign);
+
+    // The final coefficients of the product polynomial are non-negative
+    assert(r1Sign == 1 && rm1Sign == 1 && rm2Sign == 1);
+
+    addInPlaceBlocks(out + k, xn + yn - k, r1, r1n);
+    addInPlaceBlocks(out + 2 * k, xn + yn - 2 * k, rm1, rm1n);
+    addInPlaceBlocks(out + 3 * k, xn + yn - 3 * k, rm2, rm2n);
+
+    free(scratch);
+}
+
+// NTT multiplication works modulo three primes of the form c * 2^k + 1 (all
+// with primitive root 3) and reconstructs each coefficient of the product
+// with the Chinese remainder theorem. Each coefficient is a sum of at most
+// min(xn, yn) products of two blocks, i.e. less than 2^22 * 2^64, which is
+// below p1 p2 p3 (~2^86.0) as long as the transform length is at most 2^23
+#define NTT_PRIME_1 998244353u // 119 * 2^23 + 1
+#define NTT_PRIME_2 167772161u // 5 * 2^25 + 1
+#define NTT_PRIME_3 469762049u // 7 * 2^26 + 1
+#define NTT_PRIMITIVE_ROOT 3
+#define NTT_MAX_LENGTH (1u << 23)
+
+static uint32_t powMod(uint32_t base, uint64_t exponent, uint32_t p) {
+    uint64_t result = 1;
+    uint64_t b = base % p;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = result * b % p;
+        }
+        b = b * b % p;
+        exponent >>= 1;
+    }
+    return result;
+}
+
+// In-place iterative number theoretic transform of length n (a power of two)
+// modulo p, which has primitive root g
+static void nttTransform(uint32_t *a, unsigned int n, uint32_t p, uint32_t g, int inverse) {
+    for (unsigned int i = 1, j = 0; i < n; i++) {
+        unsigned int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            uint32_t temp = a[i];
+            a[i] = a[j];
+            a[j] = temp;
+        }
+    }
+
+    uint32_t *roots = allocBigInt((n / 2 > 0 ? n / 2 : 1) * sizeof(uint32_t));
+
+    for (unsigned int len = 2; len <= n; len <<= 1) {
+        uint32_t w = powMod(g, (p - 1) / len, p);
+        if (inverse) {
+            w = powMod(w, p - 2, p);
+        }
+
+        unsigned int half = len / 2;
+        roots[0] = 1;
+        for (unsigned int k = 1; k < half; k++) {
+            roots[k] = (uint64_t)roots[k - 1] * w % p;
+        }
+
+        for (unsigned int i = 0; i < n; i += len) {
+            for (unsigned int k = 0; k < half; k++) {
+                uint32_t u = a[i + k];
+                uint32_t v = (uint64_t)a[i + k + half] * roots[k] % p;
+                a[i + k] = u + v >= p ? u + v - p : u + v;
+                a[i + k + half] = u >= v ? u - v : u + p - v;
+            }
+        }
+    }
+
+    free(roots);
+
+    if (inverse) {
+        uint32_t nInv = powMod(n, p - 2, p);
+        for (unsigned int i = 0; i < n; i++) {
+            a[i] = (uint64_t)a[i] * nInv % p;
+        }
+    }
+}
+
+// Cyclic convolution of x and y modulo p, with the result left in fx
+// fx and fy must each have room for n entries
+// Squaring (x and y the same array) only needs two transforms instead of three
+static void nttConvolve(uint32_t *fx, uint32_t *fy, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn, unsigned int n, uint32_t p, uint32_t g) {
+    if (x == y && xn == yn) {
+        fy = fx;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        fx[i] = i < xn ? x[i] % p : 0;
+        fy[i] = i < yn ? y[i] % p : 0;
+    }
+
+    nttTransform(fx, n, p, g, 0);
+    if (fy != fx) {
+        nttTransform(fy, n, p, g, 0);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        fx[i] = (uint64_t)fx[i] * fy[i] % p;
+    }
+    nttTransform(fx, n, p, g, 1);
+}
+
+// out = x * y via three-prime NTT, requires xn + yn <= NTT_MAX_LENGTH
+// out must have room for xn + yn blocks and must not alias x or y
+static void nttMultiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    assert(xn + yn <= NTT_MAX_LENGTH);
+
+    unsigned int n = 1;
+    while (n < xn + yn - 1) {
+        n <<= 1;
+    }
+
+    uint32_t *scratch = allocBigInt(4 * n * sizeof(uint32_t));
+    uint32_t *r1 = scratch;
+    uint32_t *r2 = scratch + n;
+    uint32_t *r3 = scratch + 2 * n;
+    uint32_t *fy = scratch + 3 * n;
+
+    nttConvolve(r1, fy, x, xn, y, yn, n, NTT_PRIME_1, NTT_PRIMITIVE_ROOT);
+    nttConvolve(r2, fy, x, xn, y, yn, n, NTT_PRIME_2, NTT_PRIMITIVE_ROOT);
+    nttConvolve(r3, fy, x, xn, y, yn, n, NTT_PRIME_3, NTT_PRIMITIVE_ROOT);
+
+    // Garner's algorithm: c = r1 + p1 t2 + p1 p2 t3
+    uint64_t p12 = (uint64_t)NTT_PRIME_1 * NTT_PRIME_2;
+    uint32_t p1InvMod2 = powMod(NTT_PRIME_1, NTT_PRIME_2 - 2, NTT_PRIME_2);
+    uint32_t p12InvMod3 = powMod(p12 % NTT_PRIME_3, NTT_PRIME_3 - 2, NTT_PRIME_3);
+
+    // Carry into the next block, as two 32-bit halves (it's less than 2^57)
+    uint64_t carryLo = 0;
+    uint64_t carryHi = 0;
+    for (unsigned int i = 0; i < xn + yn; i++) {
+        uint64_t c0 = 0;
+        uint64_t c1 = 0;
+        uint64_t c2 = 0;
+
+        if (i < xn + yn - 1) {
+            uint64_t t2 = (uint64_t)(r2[i] + NTT_PRIME_2 - r1[i] % NTT_PRIME_2) * p1InvMod2 % NTT_PRIME_2;
+            uint64_t c12 = r1[i] + NTT_PRIME_1 * t2; // c mod p1 p2, less than 2^58
+
+            uint64_t t3 = (r3[i] + NTT_PRIME_3 - c12 % NTT_PRIME_3) % NTT_PRIME_3 * p12InvMod3 % NTT_PRIME_3;
+
+            // c = c12 + p12 * t3, split into 32-bit words c0, c1, c2
+            uint64_t lo = (p12 & UINT32_MAX) * t3 + (c12 & UINT32_MAX);
+            uint64_t hi = (p12 >> 32) * t3 + (c12 >> 32) + (lo >> 32);
+            c0 = lo & UINT32_MAX;
+            c1 = hi & UINT32_MAX;
+            c2 = hi >> 32;
+        }
+
+        uint64_t s0 = carryLo + c0;
+        out[i] = (uint32_t)s0;
+        uint64_t s1 = carryHi + c1 + (s0 >> 32);
+        carryLo = s1 & UINT32_MAX;
+        carryHi = c2 + (s1 >> 32);
+    }
+    assert(carryLo == 0 && carryHi == 0);
+
+    free(scratch);
+
+#ifdef VERIFY_NTT
+    // Debug builds can check every NTT product against the schoolbook kernel
+    uint32_t *check = allocBigInt((xn + yn) * sizeof(uint32_t));
+    schoolbookMultiplyBlocks(check, x, xn, y, yn);
+    assert(memcmp(check, out, (xn + yn) * sizeof(uint32_t)) == 0);
+    free(check);
+#endif
+}
+
+// Multi-modular convolution: integer polynomials are reduced modulo as many
+// primes of the form c * 2^k + 1 as it takes for their product to exceed
+// twice the largest possible coefficient, multiplied by NTT modulo each one
+// (independently), and each coefficient is put back together by Garner's
+// algorithm. Primes are kept below 2^31 so the butterflies don't overflow
+
+// Deterministic Miller-Rabin for 32-bit n (bases 2, 7 and 61 suffice)
+static int isPrimeBlock(uint32_t n) {
+    if (n < 2) {
+        return 0;
+    }
+
+    uint32_t bases[3] = {2, 7, 61};
+    for (unsigned int i = 0; i < 3; i++) {
+        if (n == bases[i]) {
+            return 1;
+        }
+        if (n % bases[i] == 0) {
+            return 0;
+        }
+    }
+
+    uint32_t d = n - 1;
+    unsigned int r = 0;
+    while (d % 2 == 0) {
+        d /= 2;
+        r++;
+    }
+
+    for (unsigned int i = 0; i < 3; i++) {
+        uint64_t x = powMod(bases[i], d, n);
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+
+        unsigned int j = 1;
+        for (; j < r; j++) {
+            x = x * x % n;
+            if (x == n - 1) {
+                break;
+            }
+        }
+        if (j == r) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Smallest primitive root of the prime p = c * 2^k + 1
+static uint32_t primitiveRootBlock(uint32_t p, uint32_t c) {
+    uint32_t factors[32];
+    unsigned int numFactors = 0;
+    factors[numFactors++] = 2;
+    for (uint32_t q = 3; q * q <= c; q += 2) {
+        if (c % q == 0) {
+            factors[numFactors++] = q;
+            while (c % q == 0) {
+                c /= q;
+            }
+        }
+    }
+    if (c > 1 && c % 2 == 1) {
+        factors[numFactors++] = c;
+    }
+
+    for (uint32_t g = 2; ; g++) {
+        unsigned int i = 0;
+        while (i < numFactors && powMod(g, (p - 1) / factors[i], p) != 1) {
+            i++;
+        }
+        if (i == numFactors) {
+            return g;
+        }
+    }
+}
+
+// Finds primes p = c * 2^k + 1 < 2^31 (largest first) until their product
+// has more than minBits bits, storing them and their primitive roots
+// Returns how many it took, or 0 if there aren't enough such primes
+static unsigned int findNttPrimes(unsigned int k, unsigned int minBits, uint32_t **primes, uint32_t **roots) {
+    unsigned int maxPrimes = minBits / 16 + 2;
+    *primes = allocBigInt(maxPrimes * sizeof(uint32_t));
+    *roots = allocBigInt(maxPrimes * sizeof(uint32_t));
+
+    unsigned int count = 0;
+    unsigned int bits = 0;
+    for (uint32_t c = (UINT32_C(0x7fffffff) - 1) >> k; c > 0 && bits <= minBits; c--) {
+        uint32_t p = (c << k) + 1;
+        if (!isPrimeBlock(p)) {
+            continue;
+        }
+
+        assert(count < maxPrimes);
+        (*primes)[count] = p;
+        (*roots)[count] = primitiveRootBlock(p, c >> __builtin_ctz(c));
+        count++;
+        bits += 31 - leadingZerosBlock(p); // floor(log2(p))
+    }
+
+    if (bits <= minBits) {
+        free(*primes);
+        free(*roots);
+        return 0;
+    }
+    return count;
+}
+
+// |x| mod p
+static uint32_t remainderByDigitBlocks(uint32_t *x, unsigned int n, uint32_t p) {
+    uint64_t rem = 0;
+    for (unsigned int i = n; i > 0; i--) {
+        rem = ((rem << 32) | x[i - 1]) % p;
+    }
+    return rem;
+}
+
+// Writes the xn + yn - 1 coefficients of the product of the integer
+// polynomials x and y (lowest degree first) to out, as new BigInts, by
+// multi-modular NTT
+// Returns 0 (having written nothing) if the product is too long or its
+// coefficients too big for the primes available
+int convolveBigInt(struct BigInt **out, struct BigInt **x, unsigned int xn, struct BigInt **y, unsigned int yn) {
+    unsigned int outN = xn + yn - 1;
+    unsigned int k = 0;
+    while ((1u << k) < outN) {
+        k++;
+    }
+    if (k > 26) {
+        return 0;
+    }
+    unsigned int n = 1u << k;
+
+    // |coefficient| <= min(xn, yn) max|x| max|y|, and the primes' product
+    // has to be more than twice that
+    unsigned int xBits = 0;
+    unsigned int yBits = 0;
+    for (unsigned int i = 0; i < xn; i++) {
+        unsigned int bits = bitLengthBigInt(x[i]);
+        xBits = bits > xBits ? bits : xBits;
+    }
+    for (unsigned int i = 0; i < yn; i++) {
+        unsigned int bits = bitLengthBigInt(y[i]);
+        yBits = bits > yBits ? bits : yBits;
+    }
+    unsigned int termBits = 32 - leadingZerosBlock(xn < yn ? xn : yn);
+    unsigned int minBits = xBits + yBits + termBits + 1;
+
+    uint32_t *primes;
+    uint32_t *roots;
+    unsigned int numPrimes = findNttPrimes(k, minBits, &primes, &roots);
+    if (numPrimes == 0) {
+        return 0;
+    }
+
+    int square = x == y && xn == yn;
+    uint32_t *residues = allocBigInt((size_t)numPrimes * outN * sizeof(uint32_t));
+    uint32_t *xr = allocBigInt((xn + (square ? 0 : yn)) * sizeof(uint32_t));
+    uint32_t *yr = square ? xr : xr + xn;
+    uint32_t *scratch = allocBigInt(2 * n * sizeof(uint32_t));
+
+    for (unsigned int j = 0; j < numPrimes; j++) {
+        uint32_t p = primes[j];
+        for (unsigned int i = 0; i < xn; i++) {
+            uint32_t r = remainderByDigitBlocks(x[i]->blocks, x[i]->numBlocksUsed, p);
+            xr[i] = x[i]->sign == -1 && r != 0 ? p - r : r;
+        }
+        if (!square) {
+            for (unsigned int i = 0; i < yn; i++) {
+                uint32_t r = remainderByDigitBlocks(y[i]->blocks, y[i]->numBlocksUsed, p);
+                yr[i] = y[i]->sign == -1 && r != 0 ? p - r : r;
+            }
+        }
+
+        nttConvolve(scratch, scratch + n, xr, xn, yr, yn, n, p, roots[j]);
+        memcpy(residues + (size_t)j * outN, scratch, outN * sizeof(uint32_t));
+    }
+
+    free(scratch);
+    free(xr);
+
+    // inverses[j * numPrimes + i] = primes[i]^-1 mod primes[j], for i < j
+    uint32_t *inverses = allocBigInt((size_t)numPrimes * numPrimes * sizeof(uint32_t));
+    for (unsigned int j = 0; j < numPrimes; j++) {
+        for (unsigned int i = 0; i < j; i++) {
+            inverses[j * numPrimes + i] = powMod(primes[i] % primes[j], primes[j] - 2, primes[j]);
+        }
+    }
+
+    // The product of the primes, and half of it, to tell negative
+    // coefficients (which come out as residues above half) apart
+    struct BigInt *m = createWithCapacityBigInt(numPrimes + 1);
+    m->blocks[0] = 1;
+    for (unsigned int j = 0; j < numPrimes; j++) {
+        m->numBlocksUsed = multiplyAddDigitBlocks(m->blocks, m->numBlocksUsed, primes[j], 0);
+    }
+    struct BigInt *half = shiftRightBitsBigInt(m, 1);
+
+    uint32_t *digits = allocBigInt(numPrimes * sizeof(uint32_t));
+    for (unsigned int c = 0; c < outN; c++) {
+        // Mixed radix digits: value = d0 + p0 (d1 + p1 (d2 + ...))
+        for (unsigned int j = 0; j < numPrimes; j++) {
+            uint32_t p = primes[j];
+            uint64_t v = residues[(size_t)j * outN + c];
+            for (unsigned int i = 0; i < j; i++) {
+                v = (v + p - digits[i] % p) % p * inverses[j * numPrimes + i] % p;
+            }
+            digits[j] = v;
+        }
+
+        struct BigInt *value = createWithCapacityBigInt(numPrimes + 1);
+        value->blocks[0] = digits[numPrimes - 1];
+        for (unsigned int j = numPrimes - 1; j > 0; j--) {
+            value->numBlocksUsed = multiplyAddDigitBlocks(value->blocks, value->numBlocksUsed, primes[j - 1], digits[j - 1]);
+        }
+
+        if (compareAbsoluteBigInt(value, half) > 0) {
+            subtractToBigInt(value, value, m);
+        }
+        out[c] = value;
+    }
+
+    free(digits);
+    free(inverses);
+    free(residues);
+    free(primes);
+    free(roots);
+    freeBigInt(m);
+    freeBigInt(half);
+
+    return 1;
+}
+
+// out = x^2, picking an algorithm based on operand size
+// out must have room for 2n blocks and must not alias x
+static void squareBlocks(uint32_t *out, uint32_t *x, unsigned int n) {
+    if (n < KARATSUBA_SQUARE_THRESHOLD) {
+        schoolbookSquareBlocks(out, x, n);
+    } else if (n >= NTT_SQUARE_THRESHOLD && 2 * n <= NTT_MAX_LENGTH) {
+        nttMultiplyBlocks(out, x, n, x, n);
+    } else if (n >= TOOM3_SQUARE_THRESHOLD) {
+        toom3MultiplyBlocks(out, x, n, x, n);
+    } else {
+        karatsubaMultiplyBlocks(out, x, n, x, n);
+    }
+}
+
+// out = x * y, picking an algorithm based on operand sizes
+// out must have room for xn + yn blocks and must not alias x or y
+// If x and y are the same array, this squares instead
+static void multiplyBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t *y, unsigned int yn) {
+    if (x == y && xn == yn) {
+        squareBlocks(out, x, xn);
+        return;
+    }
+
+    if (xn < yn) {
+        uint32_t *temp = x; x = y; y = temp;
+        unsigned int tempN = xn; xn = yn; yn = tempN;
+    }
+
+    if (yn < KARATSUBA_THRESHOLD) {
+        schoolbookMultiplyBlocks(out, x, xn, y, yn);
+        return;
+    }
+
+    if (yn >= NTT_THRESHOLD && xn + yn <= NTT_MAX_LENGTH) {
+        nttMultiplyBlocks(out, x, xn, y, yn);
+        return;
+    }
+
+    if (2 * yn <= xn + 1) {
+        // Very unbalanced: split x into yn-sized pieces and multiply each by y
+        uint32_t *temp = allocBigInt(2 * yn * sizeof(uint32_t));
+        for (unsigned int i = 0; i < xn + yn; i++) {
+            out[i] = 0;
+        }
+
+        for (unsigned int i = 0; i < xn; i += yn) {
+            unsigned int pieceN = xn - i < yn ? xn - i : yn;
+            multiplyBlocks(temp, x + i, pieceN, y, yn);
+            addInPlaceBlocks(out + i, xn + yn - i, temp, pieceN + yn);
+        }
+
+        free(temp);
+        return;
+    }
+
+    if (yn >= TOOM3_THRESHOLD && yn > 2 * ((xn + 2) / 3)) {
+        toom3MultiplyBlocks(out, x, xn, y, yn);
+    } else {
+        karatsubaMultiplyBlocks(out, x, xn, y, yn);
+    }
+}
+
+// Sets numBlocksUsed to exclude leading zero blocks, and makes zero positive
+static void trimBigInt(struct BigInt *x) {
+    x->numBlocksUsed = trimLengthBlocks(x->blocks, x->numBlocksUsed);
+    if (x->numBlocksUsed == 1 && x->blocks[0] == 0) {
+        x->sign = 1;
+    }
+}
+
+// out = x + ySign * |y|, shared by addBigInt and subtractBigInt
+static struct BigInt *addSignedBigInt(struct BigInt *x, struct BigInt *y, int ySign) {
+    // Single blocks add up to less than 2^33, so work on machine words
+    if (x->numBlocksUsed == 1 && y->numBlocksUsed == 1) {
+        int64_t sum = x->sign * (int64_t)x->blocks[0] + ySign * (int64_t)y->blocks[0];
+        return createFromWordBigInt(sum < 0 ? -sum : sum, sum < 0 ? -1 : 1);
+    }
+
+    unsigned int n = x->numBlocksUsed > y->numBlocksUsed ? x->numBlocksUsed : y->numBlocksUsed;
+
+    struct BigInt *out = createWithCapacityBigInt(n + 1);
+    out->numBlocksUsed = addSignedBlocks(
+        out->blocks, &out->sign,
+        x->blocks, x->numBlocksUsed, x->sign,
+        y->blocks, y->numBlocksUsed, ySign
+    );
+
+    return out;
+}
+
+struct BigInt *addBigInt(struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    return addSignedBigInt(x, y, y->sign);
+}
+
+struct BigInt *subtractBigInt(struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    return addSignedBigInt(x, y, -y->sign);
+}
+
+struct BigInt *multiplyBigInt(struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    if (x->numBlocksUsed == 1 && y->numBlocksUsed == 1) {
+        return createFromWordBigInt((uint64_t)x->blocks[0] * y->blocks[0], x->sign * y->sign);
+    }
+
+    if (x->numBlocksUsed == 1 || y->numBlocksUsed == 1) {
+        struct BigInt *digit = x->numBlocksUsed == 1 ? x : y;
+        struct BigInt *out = multiplyByDigitBigInt(digit == x ? y : x, digit->blocks[0]);
+        if (!isZeroBigInt(out)) {
+            out->sign = x->sign * y->sign;
+        }
+        return out;
+    }
+
+    struct BigInt *out = createWithCapacityBigInt(x->numBlocksUsed + y->numBlocksUsed);
+    out->numBlocksUsed = x->numBlocksUsed + y->numBlocksUsed;
+    multiplyBlocks(out->blocks, x->blocks, x->numBlocksUsed, y->blocks, y->numBlocksUsed);
+    trimBigInt(out);
+
+    out->sign = x->sign * y->sign;
+    return out;
+}
+
+// Returns x * y for a single block y, in one pass over x
+struct BigInt *multiplyByDigitBigInt(struct BigInt *x, uint32_t y) {
+    checkBigInt(x);
+
+    unsigned int n = x->numBlocksUsed;
+    struct BigInt *out = createWithCapacityBigInt(n + 1);
+    memcpy(out->blocks, x->blocks, n * sizeof(uint32_t));
+    out->numBlocksUsed = multiplyAddDigitBlocks(out->blocks, n, y, 0);
+    out->sign = isZeroBigInt(out) ? 1 : x->sign;
+
+    return out;
+}
+
+struct BigInt *squareBigInt(struct BigInt *x) {
+    checkBigInt(x);
+
+    if (x->numBlocksUsed == 1) {
+        return createFromWordBigInt((uint64_t)x->blocks[0] * x->blocks[0], 1);
+    }
+
+    struct BigInt *out = createWithCapacityBigInt(2 * x->numBlocksUsed);
+    out->numBlocksUsed = 2 * x->numBlocksUsed;
+    squareBlocks(out->blocks, x->blocks, x->numBlocksUsed);
+    trimBigInt(out);
+
+    return out;
+}
+
+// Destination-passing versions of the arithmetic above, which write the
+// result into an existing BigInt and reuse its blocks when there's room, so
+// that loops updating a number in place don't allocate on every step
+// dst may be the same BigInt as either operand
+
+// Scratch space for products that can't be written straight into dst, kept
+// between calls so that once it's big enough it never has to be allocated
+static uint32_t *scratchBlocks = NULL;
+static unsigned int numScratchBlocks = 0;
+
+static uint32_t *getScratchBlocks(unsigned int numBlocks) {
+    if (numScratchBlocks < numBlocks) {
+        free(scratchBlocks);
+        numScratchBlocks = numBlocks > 2 * numScratchBlocks ? numBlocks : 2 * numScratchBlocks;
+        scratchBlocks = allocBigInt(numScratchBlocks * sizeof(uint32_t));
+    }
+    return scratchBlocks;
+}
+
+// dst = x + ySign * |y|
+static void addSignedToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y, int ySign) {
+    // Read everything before reserving, in case dst is x or y
+    unsigned int xn = x->numBlocksUsed;
+    unsigned int yn = y->numBlocksUsed;
+    int xSign = x->sign;
+
+    reserveBlocksBigInt(dst, (xn > yn ? xn : yn) + 1);
+    dst->numBlocksUsed = addSignedBlocks(
+        dst->blocks, &dst->sign,
+        x->blocks, xn, xSign,
+        y->blocks, yn, ySign
+    );
+}
+
+// dst = x + y
+void addToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    addSignedToBigInt(dst, x, y, y->sign);
+}
+
+// dst = x - y
+void subtractToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    addSignedToBigInt(dst, x, y, -y->sign);
+}
+
+// dst = x * y
+void multiplyToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    unsigned int n = x->numBlocksUsed + y->numBlocksUsed;
+    int sign = x->sign * y->sign;
+
+    if (dst == x || dst == y) {
+        uint32_t *product = getScratchBlocks(n);
+        multiplyBlocks(product, x->blocks, x->numBlocksUsed, y->blocks, y->numBlocksUsed);
+        reserveBlocksBigInt(dst, n);
+        memcpy(dst->blocks, product, n * sizeof(uint32_t));
+    } else {
+        reserveBlocksBigInt(dst, n);
+        multiplyBlocks(dst->blocks, x->blocks, x->numBlocksUsed, y->blocks, y->numBlocksUsed);
+    }
+
+    dst->numBlocksUsed = n;
+    dst->sign = sign;
+    trimBigInt(dst);
+}
+
+// dst += productSign * |x * y|
+static void multiplyAddSignedBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y, int productSign) {
+    if (isZeroBigInt(x) || isZeroBigInt(y)) {
+        return;
+    }
+
+    unsigned int n = x->numBlocksUsed + y->numBlocksUsed;
+    uint32_t *product = getScratchBlocks(n);
+    multiplyBlocks(product, x->blocks, x->numBlocksUsed, y->blocks, y->numBlocksUsed);
+    n = trimLengthBlocks(product, n);
+
+    unsigned int dn = dst->numBlocksUsed;
+    reserveBlocksBigInt(dst, (dn > n ? dn : n) + 1);
+    dst->numBlocksUsed = addSignedBlocks(
+        dst->blocks, &dst->sign,
+        dst->blocks, dn, dst->sign,
+        product, n, productSign
+    );
+}
+
+// dst += x * y
+void multiplyAddBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y) {
+    checkBigInt(dst);
+    checkBigInt(x);
+    checkBigInt(y);
+
+    multiplyAddSignedBigInt(dst, x, y, x->sign * y->sign);
+}
+
+// dst -= x * y
+void multiplySubtractBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y) {
+    checkBigInt(dst);
+    checkBigInt(x);
+    checkBigInt(y);
+
+    multiplyAddSignedBigInt(dst, x, y, -x->sign * y->sign);
+}
+
+// dst = x * y for a single block y
+void multiplyByDigitToBigInt(struct BigInt *dst, struct BigInt *x, uint32_t y) {
+    checkBigInt(x);
+
+    unsigned int n = x->numBlocksUsed;
+    int sign = x->sign;
+
+    reserveBlocksBigInt(dst, n + 1);
+    if (dst != x) {
+        memcpy(dst->blocks, x->blocks, n * sizeof(uint32_t));
+    }
+
+    dst->numBlocksUsed = multiplyAddDigitBlocks(dst->blocks, n, y, 0);
+    dst->sign = isZeroBigInt(dst) ? 1 : sign;
+}
+
+struct BigInt *shiftRightBigInt(struct BigInt *x, unsigned int places) {
+    checkBigInt(x);
+
+    unsigned int xBlocks = x->numBlocksUsed;
+    assert(xBlocks > places);
+    unsigned int newNumBlocks = xBlocks - places;
+    
+    struct BigInt *out = createBigInt(0);
+    useBlocksBigInt(out, newNumBlocks);
+
+    for (unsigned int i = 0; i < newNumBlocks; i++) {
+        out->blocks[i] = x->blocks[i + places];
+    }
+
+    out->sign = x->sign;
+    return out;
+}
+
+struct BigInt *shiftLeftBigInt(struct BigInt *x, unsigned int places) {
+    checkBigInt(x);
+
+    struct BigInt *out = createBigInt(0);
+
+    if (isZeroBigInt(x)) {
+        return out;
+    }
+
+    useBlocksBigInt(out, x->numBlocksUsed + places);
+
+    for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
+        out->blocks[i + places] = x->blocks[i];
+    }
+
+    out->sign = x->sign;
+    return out;
+}
+
+struct BigIntDigitPair *divideByDigitBigInt(struct BigInt *x, uint32_t y) {
+    checkBigInt(x);
+    assert(y != 0);
+
+    unsigned int n = x->numBlocksUsed;
+
+    // One extra block in case rounding a negative quotient down carries
+    struct BigInt *q = createWithCapacityBigInt(n + 1);
+    uint32_t r = divideByDigitBlocks(q->blocks, x->blocks, n, y);
+    q->numBlocksUsed = n;
+
+    // Remainder is never negative, so a negative quotient is rounded down
+    if (x->sign == -1 && r != 0) {
+        q->numBlocksUsed = incrementBlocks(q->blocks, n);
+        r = y - r;
+    }
+
+    trimBigInt(q);
+    if (!isZeroBigInt(q)) {
+        q->sign = x->sign;
+    }
+
+    return createBigIntDigitPair(q, r);
+}
+
+// Division crossover points, in blocks of the divisor (and quotient).
+// Below BURNIKEL_ZIEGLER_THRESHOLD we use schoolbook long division, below
+// NEWTON_DIVISION_THRESHOLD recursive Burnikel-Ziegler division, and above
+// that (when the quotient is long) we precompute a reciprocal of the divisor
+// with Newton iteration
+#ifndef BURNIKEL_ZIEGLER_THRESHOLD
+#define BURNIKEL_ZIEGLER_THRESHOLD 64
+#endif
+
+#ifndef NEWTON_DIVISION_THRESHOLD
+#define NEWTON_DIVISION_THRESHOLD 2048
+#endif
+
+// out = x << bits (bits < 32), out must have room for n blocks (may alias x)
+// Returns the bits shifted out of the most significant block
+static uint32_t shiftLeftBitsBlocks(uint32_t *out, uint32_t *x, unsigned int n, unsigned int bits) {
+    if (bits == 0) {
+        memmove(out, x, n * sizeof(uint32_t));
+        return 0;
+    }
+
+    uint32_t carry = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        uint32_t block = x[i];
+        out[i] = (block << bits) | carry;
+        carry = block >> (32 - bits);
+    }
+    return carry;
+}
+
+// out = x >> bits (bits < 32), out must have room for n blocks (may alias x)
+static void shiftRightBitsBlocks(uint32_t *out, uint32_t *x, unsigned int n, unsigned int bits) {
+    if (bits == 0) {
+        memmove(out, x, n * sizeof(uint32_t));
+        return;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        out[i] = (x[i] >> bits) | (i + 1 < n ? x[i + 1] << (32 - bits) : 0);
+    }
+}
+
+// u -= y * v over n blocks, returns what has to be subtracted from u[n]
+// (the top of the product plus the borrow, which is at most 2^32)
+static uint64_t subtractMultipleBlocks(uint32_t *u, uint32_t *v, unsigned int n, uint32_t y) {
+    uint64_t product;
+    uint64_t diff;
+    uint32_t mulCarry = 0;
+    uint32_t borrow = 0;
+    unsigned int k = 0;
+
+#if BIGINT_WIDE_BLOCKS
+    uint64_t wideCarry = 0;
+    for (; k + 1 < n; k += 2) {
+        unsigned __int128 wideProduct = (unsigned __int128)y * loadPairBlocks(v + k) + wideCarry;
+        wideCarry = wideProduct >> 64;
+        uint64_t a = loadPairBlocks(u + k);
+        uint64_t b = (uint64_t)wideProduct;
+        uint64_t wideDiff = a - b;
+        uint32_t nextBorrow = a < b;
+        nextBorrow += wideDiff < borrow;
+        storePairBlocks(u + k, wideDiff - borrow);
+        borrow = nextBorrow;
+    }
+    mulCarry = wideCarry;
+#endif
+
+    for (; k < n; k++) {
+        product = (uint64_t)y * v[k] + mulCarry;
+        mulCarry = product >> 32;
+        diff = (uint64_t)u[k] - (uint32_t)product - borrow;
+        u[k] = (uint32_t)diff;
+        borrow = (diff >> 32) & 1;
+    }
+
+    return (uint64_t)mulCarry + borrow;
+}
+
+// Knuth's algorithm D on block arrays
+// u has un + 1 blocks and v has vn >= 2 blocks, with the top bit of v set
+// Writes the un - vn + 1 block quotient to q and leaves the remainder in
+// u[0..vn) (the rest of u ends up zero)
+static void schoolbookDivideBlocks(uint32_t *q, uint32_t *u, unsigned int un, uint32_t *v, unsigned int vn) {
+    assert(vn >= 2 && un >= vn && (v[vn - 1] >> 31) == 1);
+
+    uint64_t b = (uint64_t)1 << 32;
+    uint32_t v1 = v[vn - 1];
+    uint32_t v2 = v[vn - 2];
+
+    for (unsigned int i = un - vn + 1; i > 0; i--) {
+        unsigned int j = i - 1;
+
+        // Estimate the quotient block from the top blocks, which is at most
+        // two too big after the correction using v2
+        uint64_t top = ((uint64_t)u[j + vn] << 32) | u[j + vn - 1];
+        uint64_t qhat = top / v1;
+        uint64_t rhat = top % v1;
+        while (qhat >= b || qhat * v2 > ((rhat << 32) | u[j + vn - 2])) {
+            qhat--;
+            rhat += v1;
+            if (rhat >= b) {
+                break;
+            }
+        }
+
+        // u[j..j+vn] -= qhat * v
+        uint64_t carry = subtractMultipleBlocks(u + j, v, vn, (uint32_t)qhat);
+        uint64_t diff = (uint64_t)u[j + vn] - carry;
+        u[j + vn] = (uint32_t)diff;
+        uint32_t borrow = (diff >> 63) & 1;
+
+        // qhat was one too big, add v back
+        if (borrow) {
+            qhat--;
+            u[j + vn] += addBlocks(u + j, u + j, vn, v, vn);
+        }
+
+        q[j] = (uint32_t)qhat;
+    }
+}
+
+// Returns x with only blocks [from, to) kept (shifted down by from blocks)
+static struct BigInt *sliceBigInt(struct BigInt *x, unsigned int from, unsigned int to) {
+    struct BigInt *out = createBigInt(0);
+
+    if (to > x->numBlocksUsed) {
+        to = x->numBlocksUsed;
+    }
+
+    if (from >= to) {
+        return out;
+    }
+
+    useBlocksBigInt(out, to - from);
+    memcpy(out->blocks, x->blocks + from, (to - from) * sizeof(uint32_t));
+    trimBigInt(out);
+
+    return out;
+}
+
+// Returns |x| shifted left by the given number of bits
+static struct BigInt *shiftLeftBitsMagnitudeBigInt(struct BigInt *x, unsigned int bits) {
+    unsigned int places = bits / 32;
+    unsigned int n = x->numBlocksUsed;
+
+    struct BigInt *out = createBigInt(0);
+    useBlocksBigInt(out, n + places + 1);
+    memset(out->blocks, 0, places * sizeof(uint32_t));
+    out->blocks[n + places] = shiftLeftBitsBlocks(out->blocks + places, x->blocks, n, bits % 32);
+    trimBigInt(out);
+
+    return out;
+}
+
+// Returns |x| shifted right by the given number of bits
+static struct BigInt *shiftRightBitsMagnitudeBigInt(struct BigInt *x, unsigned int bits) {
+    struct BigInt *out = sliceBigInt(x, bits / 32, x->numBlocksUsed);
+    shiftRightBitsBlocks(out->blocks, out->blocks, out->numBlocksUsed, bits % 32);
+    trimBigInt(out);
+
+    return out;
+}
+
+// Returns x * 2^bits
+struct BigInt *shiftLeftBitsBigInt(struct BigInt *x, unsigned int bits) {
+    checkBigInt(x);
+
+    struct BigInt *out = shiftLeftBitsMagnitudeBigInt(x, bits);
+    if (!isZeroBigInt(out)) {
+        out->sign = x->sign;
+    }
+    return out;
+}
+
+// Returns x / 2^bits, rounded toward zero (like shiftRightBigInt, this keeps
+// the sign and shifts the magnitude)
+struct BigInt *shiftRightBitsBigInt(struct BigInt *x, unsigned int bits) {
+    checkBigInt(x);
+
+    struct BigInt *out = shiftRightBitsMagnitudeBigInt(x, bits);
+    if (!isZeroBigInt(out)) {
+        out->sign = x->sign;
+    }
+    return out;
+}
+
+// Returns the number of bits in |x|, zero for zero
+unsigned int bitLengthBigInt(struct BigInt *x) {
+    checkBigInt(x);
+
+    unsigned int n = x->numBlocksUsed;
+    return 32 * n - leadingZerosBlock(x->blocks[n - 1]);
+}
+
+// Kronecker substitution: packing n integers x[i] into slots of s blocks gives
+// x[0] + x[1] 2^(32 s) + x[2] 2^(64 s) + ..., so that a polynomial product
+// becomes a single BigInt product. Slots are signed, and unpacking gives back
+// each slot's value as long as all of them are below 2^(32 s - 1) in absolute
+// value
+
+// Returns the sum of x[i] 2^(32 s i), each |x[i]| must fit in s blocks
+struct BigInt *packSlotsBigInt(struct BigInt **x, unsigned int n, unsigned int s) {
+    struct BigInt *pos = createWithCapacityBigInt(n * s);
+    struct BigInt *neg = createWithCapacityBigInt(n * s);
+    useBlocksBigInt(pos, n * s);
+    useBlocksBigInt(neg, n * s);
+
+    for (unsigned int i = 0; i < n; i++) {
+        checkBigInt(x[i]);
+        assert(x[i]->numBlocksUsed <= s);
+
+        struct BigInt *target = x[i]->sign == 1 ? pos : neg;
+        memcpy(target->blocks + i * s, x[i]->blocks, x[i]->numBlocksUsed * sizeof(uint32_t));
+    }
+
+    trimBigInt(pos);
+    trimBigInt(neg);
+    subtractToBigInt(pos, pos, neg);
+    freeBigInt(neg);
+
+    return pos;
+}
+
+// Writes the n signed slots of x (packed by packSlotsBigInt) to out, as new
+// BigInts. A slot whose top bit is set (after the carry from the slot below)
+// holds a negative value, which borrows one from the slot above
+void unpackSlotsBigInt(struct BigInt *x, unsigned int n, unsigned int s, struct BigInt **out) {
+    checkBigInt(x);
+
+    uint32_t carry = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        struct BigInt *v = createWithCapacityBigInt(s + 1);
+        useBlocksBigInt(v, s + 1);
+
+        unsigned int from = i * s;
+        unsigned int to = from + s < x->numBlocksUsed ? from + s : x->numBlocksUsed;
+        if (from < to) {
+            memcpy(v->blocks, x->blocks + from, (to - from) * sizeof(uint32_t));
+        }
+        if (carry) {
+            incrementBlocks(v->blocks, s);
+        }
+
+        carry = v->blocks[s] != 0 || (v->blocks[s - 1] >> 31) != 0;
+        if (carry) {
+            // v - 2^(32 s), as the two's complement of the slot
+            v->blocks[s] = 0;
+            for (unsigned int k = 0; k < s; k++) {
+                v->blocks[k] = ~v->blocks[k];
+            }
+            incrementBlocks(v->blocks, s);
+            v->blocks[s] = 0;
+            v->sign = -1;
+        }
+
+        trimBigInt(v);
+        if (isZeroBigInt(v)) {
+            v->sign = 1;
+        } else if (x->sign == -1) {
+            v->sign = -v->sign;
+        }
+        out[i] = v;
+    }
+    assert(carry == 0);
+}
+
+// Long division of |a| by |b|
+// Makes a constant number of allocations no matter how long the quotient is:
+// the remainder is computed in place in r's blocks, and the divisor is only
+// copied if it needs normalizing (which is a bit shift)
+// q gets one spare block so that divideBigInt can round it without growing
+static void schoolbookDivideMagnitudeBigInt(struct BigInt *a, struct BigInt *b, struct BigInt **q, struct BigInt **r) {
+    unsigned int n = b->numBlocksUsed;
+    unsigned int an = a->numBlocksUsed;
+
+    if (an < n) {
+        *q = createWithCapacityBigInt(2);
+        *r = copyBigInt(a);
+        (*r)->sign = 1;
+        return;
+    }
+
+    *q = createWithCapacityBigInt(an - n + 2);
+    (*q)->numBlocksUsed = an - n + 1;
+
+    if (n == 1) {
+        *r = createBigInt(divideByDigitBlocks((*q)->blocks, a->blocks, an, b->blocks[0]));
+        trimBigInt(*q);
+        return;
+    }
+
+    // Normalize so the top bit of the divisor is set
+    unsigned int shift = leadingZerosBlock(b->blocks[n - 1]);
+    uint32_t *v = b->blocks;
+    if (shift != 0) {
+        v = allocBigInt(n * sizeof(uint32_t));
+        shiftLeftBitsBlocks(v, b->blocks, n, shift);
+    }
+
+    *r = createWithCapacityBigInt(an + 1);
+    uint32_t *u = (*r)->blocks;
+    u[an] = shiftLeftBitsBlocks(u, a->blocks, an, shift);
+
+    schoolbookDivideBlocks((*q)->blocks, u, an, v, n);
+
+    shiftRightBitsBlocks(u, u, n, shift);
+    (*r)->numBlocksUsed = n;
+
+    if (v != b->blocks) {
+        free(v);
+    }
+
+    trimBigInt(*q);
+    trimBigInt(*r);
+}
+
+static void divide3n2nBigInt(struct BigInt *a, struct BigInt *b, unsigned int h, struct BigInt **q, struct BigInt **r);
+
+// Burnikel-Ziegler division of a 2n block number by an n block number
+// Requires b to have exactly n blocks with the top bit set, and a < b * B^n
+// (so the quotient fits in n blocks)
+static void divide2n1nBigInt(struct BigInt *a, struct BigInt *b, unsigned int n, struct BigInt **q, struct BigInt **r) {
+    if (n % 2 == 1 || n < BURNIKEL_ZIEGLER_THRESHOLD) {
+        schoolbookDivideMagnitudeBigInt(a, b, q, r);
+        return;
+    }
+
+    unsigned int h = n / 2;
+    struct BigInt *q1;
+    struct BigInt *q2;
+    struct BigInt *r1;
+    struct BigInt *temp;
+
+    // Divide the top three halves of a, then the remainder with the last half
+    temp = sliceBigInt(a, h, 4 * h);
+    divide3n2nBigInt(temp, b, h, &q1, &r1);
+    freeBigInt(temp);
+
+    replaceBigInt(&r1, shiftLeftBigInt(r1, h));
+    temp = sliceBigInt(a, 0, h);
+    replaceBigInt(&r1, addBigInt(r1, temp));
+    freeBigInt(temp);
+
+    divide3n2nBigInt(r1, b, h, &q2, r);
+    freeBigInt(r1);
+
+    *q = shiftLeftBigInt(q1, h);
+    replaceBigInt(q, addBigInt(*q, q2));
+    freeBigInt(q1);
+    freeBigInt(q2);
+}
+
+// Divides a 3h block number by a 2h block number (b = b1 * B^h + b2)
+// Requires the top bit of b to be set, and a < b * B^h
+static void divide3n2nBigInt(struct BigInt *a, struct BigInt *b, unsigned int h, struct BigInt **q, struct BigInt **r) {
+    struct BigInt *a1 = sliceBigInt(a, 2 * h, 3 * h);
+    struct BigInt *a12 = sliceBigInt(a, h, 3 * h);
+    struct BigInt *b1 = sliceBigInt(b, h, 2 * h);
+    struct BigInt *b2 = sliceBigInt(b, 0, h);
+    struct BigInt *qhat;
+    struct BigInt *rhat;
+    struct BigInt *temp;
+
+    if (compareAbsoluteBigInt(a1, b1) < 0) {
+        divide2n1nBigInt(a12, b1, h, &qhat, &rhat);
+    } else {
+        // The quotient estimate is capped at B^h - 1, and then
+        // a12 - qhat * b1 = a12 - b1 * B^h + b1
+        qhat = createBigInt(0);
+        useBlocksBigInt(qhat, h);
+        memset(qhat->blocks, 0xff, h * sizeof(uint32_t));
+
+        temp = shiftLeftBigInt(b1, h);
+        rhat = subtractBigInt(a12, temp);
+        replaceBigInt(&rhat, addBigInt(rhat, b1));
+        freeBigInt(temp);
+    }
+
+    // rhat = rhat * B^h + a3 - qhat * b2, which is off by at most two b's
+    replaceBigInt(&rhat, shiftLeftBigInt(rhat, h));
+    temp = sliceBigInt(a, 0, h);
+    replaceBigInt(&rhat, addBigInt(rhat, temp));
+    replaceBigInt(&temp, multiplyBigInt(qhat, b2));
+    replaceBigInt(&rhat, subtractBigInt(rhat, temp));
+
+    temp->blocks[0] = 1;
+    temp->numBlocksUsed = 1;
+    temp->sign = 1;
+    while (rhat->sign == -1) {
+        replaceBigInt(&rhat, addBigInt(rhat, b));
+        replaceBigInt(&qhat, subtractBigInt(qhat, temp));
+    }
+
+    freeBigInt(temp);
+    freeBigInt(a1);
+    freeBigInt(a12);
+    freeBigInt(b1);
+    freeBigInt(b2);
+
+    *q = qhat;
+    *r = rhat;
+}
+
+// Returns floor(B^2n / y) via Newton iteration, where y has n blocks with the
+// top bit set
+// Each step computes a reciprocal of the top half of y (plus a couple of
+// guard blocks) recursively, and then does a single Newton step
+// r = r + r (B^2n - y r) / B^2n, which doubles the number of correct blocks
+// Only the outermost call (exact = 1) fixes up the last few units of error
+static struct BigInt *reciprocalBigInt(struct BigInt *y, unsigned int n, int exact) {
+    struct BigInt *one = createBigInt(1);
+    struct BigInt *power = shiftLeftBigInt(one, 2 * n);
+    struct BigInt *out;
+    struct BigInt *e;
+    struct BigInt *temp;
+
+    // The recursion needs n / 2 + 2 < n to make progress
+    if (n < BURNIKEL_ZIEGLER_THRESHOLD || n < 8) {
+        schoolbookDivideMagnitudeBigInt(power, y, &out, &temp);
+        freeBigInt(temp);
+        freeBigInt(power);
+        freeBigInt(one);
+        return out;
+    }
+
+    unsigned int h = n / 2 + 2;
+    temp = sliceBigInt(y, n - h, n);
+    out = reciprocalBigInt(temp, h, 0);
+    replaceBigInt(&out, shiftLeftBigInt(out, n - h));
+    freeBigInt(temp);
+
+    // e = B^2n - y r, then r += floor(r e / B^2n)
+    temp = multiplyBigInt(y, out);
+    e = subtractBigInt(power, temp);
+    replaceBigInt(&temp, multiplyBigInt(out, e));
+    int sign = temp->sign;
+    replaceBigInt(&temp, sliceBigInt(temp, 2 * n, temp->numBlocksUsed));
+    temp->sign = isZeroBigInt(temp) ? 1 : sign;
+    replaceBigInt(&out, addBigInt(out, temp));
+
+    if (exact) {
+        replaceBigInt(&temp, multiplyBigInt(y, out));
+        replaceBigInt(&e, subtractBigInt(power, temp));
+        while (e->sign == -1) {
+            replaceBigInt(&out, subtractBigInt(out, one));
+            replaceBigInt(&e, addBigInt(e, y));
+        }
+        while (compareBigInt(e, y) >= 0) {
+            replaceBigInt(&out, addBigInt(out, one));
+            replaceBigInt(&e, subtractBigInt(e, y));
+        }
+    }
+
+    freeBigInt(temp);
+    freeBigInt(e);
+    freeBigInt(power);
+    freeBigInt(one);
+    return out;
+}
+
+// Barrett division of a 2n block number by an n block number, given
+// reciprocal = floor(B^2n / b)
+// Requires b to have exactly n blocks with the top bit set, and a < b * B^n
+static void divide2n1nReciprocalBigInt(struct BigInt *a, struct BigInt *b, struct BigInt *reciprocal, unsigned int n, struct BigInt **q, struct BigInt **r) {
+    // q = floor(floor(a / B^(n-1)) * reciprocal / B^(n+1)) is at most two too small
+    struct BigInt *temp = sliceBigInt(a, n - 1, a->numBlocksUsed);
+    replaceBigInt(&temp, multiplyBigInt(temp, reciprocal));
+    *q = sliceBigInt(temp, n + 1, temp->numBlocksUsed);
+
+    replaceBigInt(&temp, multiplyBigInt(*q, b));
+    *r = subtractBigInt(a, temp);
+
+    temp->blocks[0] = 1;
+    temp->numBlocksUsed = 1;
+    temp->sign = 1;
+    while (compareBigInt(*r, b) >= 0) {
+        replaceBigInt(r, subtractBigInt(*r, b));
+        replaceBigInt(q, addBigInt(*q, temp));
+    }
+
+    freeBigInt(temp);
+}
+
+// Divides |x| by |y| for large operands (|x| >= |y|, y at least two blocks)
+// using Burnikel-Ziegler recursion, or Newton reciprocals for huge divisors
+// Both work on 2n by n block pieces: the divisor is padded to n blocks and
+// normalized so its top bit is set, and the dividend is consumed n blocks at
+// a time from the top, like the digits in schoolbook long division
+static void divideLargeMagnitudeBigInt(struct BigInt *x, struct BigInt *y, struct BigInt **q, struct BigInt **r) {
+    unsigned int yn = y->numBlocksUsed;
+
+    // The reciprocal costs a few multiplications to compute but is then
+    // reused for every piece, so Newton only wins for long quotients
+    int useNewton = yn >= NEWTON_DIVISION_THRESHOLD && x->numBlocksUsed - yn >= 8 * yn;
+
+    // For Burnikel-Ziegler, pad the divisor to j * 2^k blocks with
+    // j < BURNIKEL_ZIEGLER_THRESHOLD, so the recursion halves cleanly
+    unsigned int n = yn;
+    if (!useNewton) {
+        unsigned int m = 1;
+        while ((yn + m - 1) / m >= BURNIKEL_ZIEGLER_THRESHOLD) {
+            m *= 2;
+        }
+        n = (yn + m - 1) / m * m;
+    }
+
+    unsigned int shift = 32 * (n - yn) + leadingZerosBlock(y->blocks[yn - 1]);
+    struct BigInt *b = shiftLeftBitsMagnitudeBigInt(y, shift);
+    struct BigInt *a = shiftLeftBitsMagnitudeBigInt(x, shift);
+    assert(b->numBlocksUsed == n);
+
+    // The top piece has fewer than n blocks, so it's less than b
+    unsigned int t = a->numBlocksUsed / n + 1;
+
+    struct BigInt *reciprocal = useNewton ? reciprocalBigInt(b, n, 1) : NULL;
+    struct BigInt *z = sliceBigInt(a, (t - 2) * n, t * n);
+    struct BigInt *qi;
+    struct BigInt *ri;
+    struct BigInt *temp;
+
+    *q = createBigInt(0);
+    useBlocksBigInt(*q, (t - 1) * n);
+
+    for (unsigned int i = t - 1; i > 0; i--) {
+        if (useNewton) {
+            divide2n1nReciprocalBigInt(z, b, reciprocal, n, &qi, &ri);
+        } else {
+            divide2n1nBigInt(z, b, n, &qi, &ri);
+        }
+
+        assert(qi->numBlocksUsed <= n);
+        memcpy((*q)->blocks + (i - 1) * n, qi->blocks, qi->numBlocksUsed * sizeof(uint32_t));
+        freeBigInt(qi);
+
+        if (i > 1) {
+            replaceBigInt(&z, shiftLeftBigInt(ri, n));
+            temp = sliceBigInt(a, (i - 2) * n, (i - 1) * n);
+            replaceBigInt(&z, addBigInt(z, temp));
+            freeBigInt(temp);
+            freeBigInt(ri);
+        }
+    }
+
+    trimBigInt(*q);
+    *r = shiftRightBitsMagnitudeBigInt(ri, shift);
+
+    freeBigInt(ri);
+    freeBigInt(z);
+    freeBigInt(a);
+    freeBigInt(b);
+    if (reciprocal != NULL) {
+        freeBigInt(reciprocal);
+    }
+}
+
+struct BigIntPair *divideBigInt(struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+    assert(!isZeroBigInt(y));
+
+    int sign = x->sign * y->sign;
+    struct BigInt *q;
+    struct BigInt *r;
+
+    if (y->numBlocksUsed >= BURNIKEL_ZIEGLER_THRESHOLD
+            && x->numBlocksUsed >= y->numBlocksUsed + BURNIKEL_ZIEGLER_THRESHOLD) {
+        divideLargeMagnitudeBigInt(x, y, &q, &r);
+    } else {
+        schoolbookDivideMagnitudeBigInt(x, y, &q, &r);
+    }
+
+    // The remainder is never negative, so if the quotient is negative and
+    // inexact, it's rounded away from zero and the remainder is |y| - r
+    if (sign == -1 && !isZeroBigInt(r)) {
+        useBlocksBigInt(q, q->numBlocksUsed + 1);
+        q->numBlocksUsed = incrementBlocks(q->blocks, q->numBlocksUsed - 1);
+
+        useBlocksBigInt(r, y->numBlocksUsed);
+        subtractBlocks(r->blocks, y->blocks, y->numBlocksUsed, r->blocks, y->numBlocksUsed);
+        trimBigInt(r);
+    }
+
+    if (!isZeroBigInt(q)) {
+        q->sign = sign;
+    }
+
+    return createBigIntPair(q, r);
+}
+
+// GCD crossover points, in blocks of the smaller operand. Numbers that fit in
+// 64 bits use binary GCD, below HALF_GCD_THRESHOLD we use Lehmer's
+// algorithm, and above it the subquadratic half-GCD, which itself falls back
+// to Lehmer steps below HALF_GCD_BASE_THRESHOLD
+#ifndef HALF_GCD_THRESHOLD
+#define HALF_GCD_THRESHOLD 2048
+#endif
+
+#ifndef HALF_GCD_BASE_THRESHOLD
+#define HALF_GCD_BASE_THRESHOLD 64
+#endif
+
+#if HALF_GCD_BASE_THRESHOLD < 4
+#error "HALF_GCD_BASE_THRESHOLD must be at least 4"
+#endif
+
+// Binary (Stein's) GCD on machine words
+static uint64_t binaryGcdWord(uint64_t u, uint64_t v) {
+    if (u == 0) {
+        return v;
+    }
+    if (v == 0) {
+        return u;
+    }
+
+    unsigned int shift = 0;
+    while (((u | v) & 1) == 0) {
+        u >>= 1;
+        v >>= 1;
+        shift++;
+    }
+
+    while ((u & 1) == 0) {
+        u >>= 1;
+    }
+
+    do {
+        while ((v & 1) == 0) {
+            v >>= 1;
+        }
+
+        if (u > v) {
+            uint64_t temp = u;
+            u = v;
+            v = temp;
+        }
+        v -= u;
+    } while (v != 0);
+
+    return u << shift;
+}
+
+// Returns bits [shift, shift + 64) of x
+static uint64_t extractBitsBlocks(uint32_t *x, unsigned int n, unsigned int shift) {
+    unsigned int i = shift / 32;
+    unsigned int bits = shift % 32;
+    uint64_t w0 = i < n ? x[i] : 0;
+    uint64_t w1 = i + 1 < n ? x[i + 1] : 0;
+    uint64_t w2 = i + 2 < n ? x[i + 2] : 0;
+
+    uint64_t out = ((w1 << 32) | w0) >> bits;
+    if (bits != 0) {
+        out |= w2 << (64 - bits);
+    }
+    return out;
+}
+
+// Lehmer's algorithm: runs Euclid's algorithm on the top 62 bits of a and b
+// (a >= b) for as long as the quotients are guaranteed to be the same as for
+// the full numbers (Knuth's algorithm L), or exactly if they fit in 62 bits
+// The result is the cofactor matrix of those steps, with
+// a' = cof[0] a + cof[1] b and b' = cof[2] a + cof[3] b
+// Cofactors are less than 2^31 in absolute value, and in each row one is
+// non-negative and the other non-positive
+// Returns the number of Euclid steps taken, so the matrix has determinant
+// (-1)^steps, or 0 if the top bits didn't determine even the first quotient
+static unsigned int lehmerCofactors(uint32_t *a, unsigned int an, uint32_t *b, unsigned int bn, int64_t *cof) {
+    unsigned int bits = 32 * an - leadingZerosBlock(a[an - 1]);
+    unsigned int shift = bits > 62 ? bits - 62 : 0;
+    int64_t ah = extractBitsBlocks(a, an, shift);
+    int64_t bh = extractBitsBlocks(b, bn, shift);
+    int64_t limit = (int64_t)1 << 31;
+
+    int64_t A = 1, B = 0, C = 0, D = 1;
+    unsigned int steps = 0;
+    while (bh != 0) {
+        int64_t q;
+        if (shift == 0) {
+            q = ah / bh;
+        } else {
+            if (bh + C <= 0 || bh + D <= 0) {
+                break;
+            }
+
+            q = (ah + A) / (bh + C);
+            if (q != (ah + B) / (bh + D)) {
+                break;
+            }
+        }
+
+        if (q >= limit) {
+            break;
+        }
+
+        int64_t nextC = A - q * C;
+        int64_t nextD = B - q * D;
+        if (nextC >= limit || nextC <= -limit || nextD >= limit || nextD <= -limit) {
+            break;
+        }
+
+        A = C;
+        B = D;
+        C = nextC;
+        D = nextD;
+
+        int64_t temp = ah - q * bh;
+        ah = bh;
+        bh = temp;
+
+        steps++;
+    }
+
+    cof[0] = A;
+    cof[1] = B;
+    cof[2] = C;
+    cof[3] = D;
+    return steps;
+}
+
+// out = ux * x - uy * y, where the result is known to be non-negative and
+// fit in max(xn, yn) blocks, returns its length (out must not alias x or y)
+static unsigned int multiplySubtractBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t ux, uint32_t *y, unsigned int yn, uint32_t uy) {
+    unsigned int n = xn > yn ? xn : yn;
+    uint64_t carryX = 0;
+    uint64_t carryY = 0;
+    uint32_t borrow = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t px = (i < xn ? (uint64_t)ux * x[i] : 0) + carryX;
+        uint64_t py = (i < yn ? (uint64_t)uy * y[i] : 0) + carryY;
+        carryX = px >> 32;
+        carryY = py >> 32;
+
+        uint64_t diff = (uint64_t)(uint32_t)px - (uint32_t)py - borrow;
+        out[i] = (uint32_t)diff;
+        borrow = (diff >> 32) & 1;
+    }
+    assert(carryX == carryY + borrow);
+
+    return trimLengthBlocks(out, n);
+}
+
+// out = p x + q y for Lehmer cofactors p and q (one is non-negative and the
+// other non-positive, and the result is non-negative)
+static void combineLehmerBigInt(struct BigInt *out, struct BigInt *x, struct BigInt *y, int64_t p, int64_t q) {
+    unsigned int n = x->numBlocksUsed > y->numBlocksUsed ? x->numBlocksUsed : y->numBlocksUsed;
+    useBlocksBigInt(out, n);
+    out->sign = 1;
+
+    if (q <= 0) {
+        out->numBlocksUsed = multiplySubtractBlocks(out->blocks, x->blocks, x->numBlocksUsed, p, y->blocks, y->numBlocksUsed, -q);
+    } else {
+        out->numBlocksUsed = multiplySubtractBlocks(out->blocks, y->blocks, y->numBlocksUsed, q, x->blocks, x->numBlocksUsed, -p);
+    }
+}
+
+// out = ux * x + uy * y, out has room for max(xn, yn) + 1 blocks, returns its
+// length (out must not alias x or y)
+static unsigned int multiplyAddBlocks(uint32_t *out, uint32_t *x, unsigned int xn, uint32_t ux, uint32_t *y, unsigned int yn, uint32_t uy) {
+    unsigned int n = xn > yn ? xn : yn;
+    uint64_t carry = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t px = i < xn ? (uint64_t)ux * x[i] : 0;
+        uint64_t py = i < yn ? (uint64_t)uy * y[i] : 0;
+
+        // Can't overflow, as each product is at most (2^32 - 1)^2
+        uint64_t sum = (uint64_t)(uint32_t)px + (uint32_t)py + carry;
+        out[i] = (uint32_t)sum;
+        carry = (sum >> 32) + (px >> 32) + (py >> 32);
+    }
+    out[n] = (uint32_t)carry;
+
+    return trimLengthBlocks(out, n + 1);
+}
+
+// Returns x times a signed cofactor (less than 2^32 in absolute value)
+static struct BigInt *multiplyByCofactorBigInt(struct BigInt *x, int64_t c) {
+    struct BigInt *temp = createBigInt(c < 0 ? -c : c);
+    if (c < 0) {
+        temp->sign = -1;
+    }
+    struct BigInt *out = multiplyBigInt(x, temp);
+    freeBigInt(temp);
+    return out;
+}
+
+// out = p x + q y for Bezout cofactors x and y and Lehmer cofactors p and q
+// Along a Euclidean remainder sequence both terms have the same sign, so
+// this is normally a single pass over the blocks
+static void combineCofactorsBigInt(struct BigInt *out, struct BigInt *x, struct BigInt *y, int64_t p, int64_t q) {
+    int xSign = p == 0 || isZeroBigInt(x) ? 0 : (p < 0 ? -x->sign : x->sign);
+    int ySign = q == 0 || isZeroBigInt(y) ? 0 : (q < 0 ? -y->sign : y->sign);
+
+    if (xSign != 0 && ySign != 0 && xSign != ySign) {
+        struct BigInt *temp1 = multiplyByCofactorBigInt(x, p);
+        struct BigInt *temp2 = multiplyByCofactorBigInt(y, q);
+        struct BigInt *sum = addBigInt(temp1, temp2);
+
+        useBlocksBigInt(out, sum->numBlocksUsed);
+        memcpy(out->blocks, sum->blocks, sum->numBlocksUsed * sizeof(uint32_t));
+        out->numBlocksUsed = sum->numBlocksUsed;
+        out->sign = sum->sign;
+
+        freeBigInt(temp1);
+        freeBigInt(temp2);
+        freeBigInt(sum);
+        return;
+    }
+
+    unsigned int n = x->numBlocksUsed > y->numBlocksUsed ? x->numBlocksUsed : y->numBlocksUsed;
+    useBlocksBigInt(out, n + 1);
+    out->numBlocksUsed = multiplyAddBlocks(out->blocks, x->blocks, x->numBlocksUsed, p < 0 ? -p : p, y->blocks, y->numBlocksUsed, q < 0 ? -q : q);
+    out->sign = isZeroBigInt(out) ? 1 : xSign + ySign > 0 ? 1 : -1;
+}
+
+// 2x2 matrix for the half-GCD, keeping track of the reduction of (a, b) to
+// (a', b') through (a, b) = M (a', b'), together with its determinant (1 or -1)
+struct BigIntMatrix {
+    struct BigInt *m[2][2];
+    int det;
+};
+
+static void initIdentityBigIntMatrix(struct BigIntMatrix *x) {
+    x->m[0][0] = createBigInt(1);
+    x->m[0][1] = createBigInt(0);
+    x->m[1][0] = createBigInt(0);
+    x->m[1][1] = createBigInt(1);
+    x->det = 1;
+}
+
+static void freeBigIntMatrix(struct BigIntMatrix *x) {
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            freeBigInt(x->m[i][j]);
+        }
+    }
+}
+
+// x = x * y
+static void multiplyBigIntMatrix(struct BigIntMatrix *x, struct BigIntMatrix *y) {
+    struct BigInt *out[2][2];
+    struct BigInt *temp;
+
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            out[i][j] = multiplyBigInt(x->m[i][0], y->m[0][j]);
+            temp = multiplyBigInt(x->m[i][1], y->m[1][j]);
+            replaceBigInt(&out[i][j], addBigInt(out[i][j], temp));
+            freeBigInt(temp);
+        }
+    }
+
+    freeBigIntMatrix(x);
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            x->m[i][j] = out[i][j];
+        }
+    }
+    x->det *= y->det;
+}
+
+// x = x * [[q, 1], [1, 0]], i.e. records the Euclid step (a, b) -> (b, a - q b)
+static void euclidStepBigIntMatrix(struct BigIntMatrix *x, struct BigInt *q) {
+    for (int i = 0; i < 2; i++) {
+        struct BigInt *temp = multiplyBigInt(x->m[i][0], q);
+        replaceBigInt(&temp, addBigInt(temp, x->m[i][1]));
+        replaceBigInt(&x->m[i][1], x->m[i][0]);
+        x->m[i][0] = temp;
+    }
+    x->det = -x->det;
+}
+
+// x = x * L^-1, where L = [[cof0, cof1], [cof2, cof3]] is a Lehmer cofactor
+// matrix with the given determinant, so L^-1 = det [[cof3, -cof1], [-cof2, cof0]]
+static void lehmerStepBigIntMatrix(struct BigIntMatrix *x, int64_t *cof, int det) {
+    for (int i = 0; i < 2; i++) {
+        struct BigInt *left = multiplyByCofactorBigInt(x->m[i][0], det * cof[3]);
+        struct BigInt *temp = multiplyByCofactorBigInt(x->m[i][1], -det * cof[2]);
+        replaceBigInt(&left, addBigInt(left, temp));
+        freeBigInt(temp);
+
+        struct BigInt *right = multiplyByCofactorBigInt(x->m[i][0], -det * cof[1]);
+        temp = multiplyByCofactorBigInt(x->m[i][1], det * cof[0]);
+        replaceBigInt(&right, addBigInt(right, temp));
+        freeBigInt(temp);
+
+        replaceBigInt(&x->m[i][0], left);
+        replaceBigInt(&x->m[i][1], right);
+    }
+    x->det *= det;
+}
+
+// (a', b') = M^-1 (a, b) = det (m11 a - m01 b, m00 b - m10 a)
+static void inverseTimesBigIntMatrix(struct BigIntMatrix *x, struct BigInt *a, struct BigInt *b, struct BigInt **a2, struct BigInt **b2) {
+    *a2 = multiplyBigInt(x->m[1][1], a);
+    struct BigInt *temp = multiplyBigInt(x->m[0][1], b);
+    replaceBigInt(a2, subtractBigInt(*a2, temp));
+
+    *b2 = multiplyBigInt(x->m[0][0], b);
+    replaceBigInt(&temp, multiplyBigInt(x->m[1][0], a));
+    replaceBigInt(b2, subtractBigInt(*b2, temp));
+    freeBigInt(temp);
+
+    if (x->det == -1) {
+        flipSignBigInt(*a2);
+        flipSignBigInt(*b2);
+    }
+}
+
+// Computes (a', b') = M^-1 (a, b) for a half-GCD matrix M
+// If that would make a' or b' negative, or a' < b' (which can happen when M
+// came from truncated numbers), M is adjusted by negating or swapping
+// columns so that a' >= b' >= 0 still holds
+static void applyInverseBigIntMatrix(struct BigIntMatrix *x, struct BigInt *a, struct BigInt *b, struct BigInt **a2, struct BigInt **b2) {
+    struct BigInt *temp;
+
+    inverseTimesBigIntMatrix(x, a, b, a2, b2);
+
+    for (int j = 0; j < 2; j++) {
+        struct BigInt *value = j == 0 ? *a2 : *b2;
+        if (value->sign == -1) {
+            flipSignBigInt(value);
+            flipSignBigInt(x->m[0][j]);
+            flipSignBigInt(x->m[1][j]);
+            x->det = -x->det;
+        }
+    }
+
+    if (compareBigInt(*a2, *b2) < 0) {
+        temp = *a2;
+        *a2 = *b2;
+        *b2 = temp;
+        for (int i = 0; i < 2; i++) {
+            temp = x->m[i][0];
+            x->m[i][0] = x->m[i][1];
+            x->m[i][1] = temp;
+        }
+        x->det = -x->det;
+    }
+}
+
+// Does one Euclid step (a, b) -> (b, a mod b), recording it in x if given
+static void euclidStepBigInt(struct BigInt **a, struct BigInt **b, struct BigIntMatrix *x) {
+    struct BigIntPair *pair = divideBigInt(*a, *b);
+    if (x != NULL) {
+        euclidStepBigIntMatrix(x, pair->x);
+    }
+    freeBigInt(pair->x);
+    replaceBigInt(a, *b);
+    *b = pair->y;
+    free(pair);
+}
+
+// Half-GCD: for a >= b >= 0 where a has n blocks, finds a matrix M such that
+// (a, b) = M (a', b') for consecutive remainders a' and b' in the Euclidean
+// remainder sequence of (a, b), with b' < B^m <= a' for m = ceil(n / 2)
+// Works recursively on the top halves of the numbers (Thull-Yap), so it
+// takes O(M(n) log n) time instead of the quadratic time Euclid would
+static void halfGcdBigInt(struct BigInt *a, struct BigInt *b, struct BigIntMatrix *out) {
+    unsigned int n = a->numBlocksUsed;
+    unsigned int m = (n + 1) / 2;
+
+    initIdentityBigIntMatrix(out);
+
+    if (b->numBlocksUsed <= m) {
+        return;
+    }
+
+    struct BigInt *a2;
+    struct BigInt *b2;
+
+    if (n < HALF_GCD_BASE_THRESHOLD) {
+        // Follow the remainder sequence directly, using Lehmer steps while
+        // b is well clear of the target size and Euclid steps near it
+        a2 = copyBigInt(a);
+        b2 = copyBigInt(b);
+        struct BigInt *a3 = createWithCapacityBigInt(n);
+        struct BigInt *b3 = createWithCapacityBigInt(n);
+        int64_t cof[4];
+
+        while (b2->numBlocksUsed > m) {
+            unsigned int steps = 0;
+            if (b2->numBlocksUsed > m + 2 && a2->numBlocksUsed >= 3) {
+                steps = lehmerCofactors(a2->blocks, a2->numBlocksUsed, b2->blocks, b2->numBlocksUsed, cof);
+            }
+
+            if (steps == 0) {
+                euclidStepBigInt(&a2, &b2, out);
+                continue;
+            }
+
+            combineLehmerBigInt(a3, a2, b2, cof[0], cof[1]);
+            combineLehmerBigInt(b3, a2, b2, cof[2], cof[3]);
+            lehmerStepBigIntMatrix(out, cof, steps % 2 == 0 ? 1 : -1);
+
+            struct BigInt *temp = a2; a2 = a3; a3 = temp;
+            temp = b2; b2 = b3; b3 = temp;
+        }
+
+        freeBigInt(a2);
+        freeBigInt(b2);
+        freeBigInt(a3);
+        freeBigInt(b3);
+        return;
+    }
 
-//        printf("tempBlock: %u\n", tempBlock);
-//        printf("yBig: "); printBigInt(yBig); printf("\n");
-
-        temp->blocks[0] = tempBlock;
-//        printf("temp: "); printBigInt(temp); printf("\n");
-        w = multiplyBigInt(temp, yBig);
-
-//        printf("u: "); printBigInt(u); printf("\n");
-//        printf("w: "); printBigInt(w); printf("\n");
+    // Reduce the top halves, and apply the result to the whole numbers
+    struct BigInt *a1 = sliceBigInt(a, m, n);
+    struct BigInt *b1 = sliceBigInt(b, m, n);
+    struct BigIntMatrix r;
+    halfGcdBigInt(a1, b1, &r);
+    freeBigInt(a1);
+    freeBigInt(b1);
 
-        if (tempBlock != 0) {
-            useBlocksBigInt(q, j + 1);
-            q->blocks[j] = tempBlock;
+    freeBigIntMatrix(out);
+    *out = r;
+    applyInverseBigIntMatrix(out, a, b, &a2, &b2);
+
+    if (b2->numBlocksUsed > m) {
+        euclidStepBigInt(&a2, &b2, out);
+    }
+
+    // a2 now has about 3n/4 blocks, so reduce its top 2(l - m) blocks
+    if (b2->numBlocksUsed > m && a2->numBlocksUsed < 2 * m) {
+        unsigned int k = 2 * m - a2->numBlocksUsed;
+        a1 = sliceBigInt(a2, k, a2->numBlocksUsed);
+        b1 = sliceBigInt(b2, k, a2->numBlocksUsed);
+        halfGcdBigInt(a1, b1, &r);
+        multiplyBigIntMatrix(out, &r);
+        freeBigIntMatrix(&r);
+        freeBigInt(a1);
+        freeBigInt(b1);
+    }
+
+    freeBigInt(a2);
+    freeBigInt(b2);
+}
+
+struct BigInt *gcdBigInt(struct BigInt *x, struct BigInt *y) {
+    checkBigInt(x);
+    checkBigInt(y);
+
+    if (x->numBlocksUsed <= 2 && y->numBlocksUsed <= 2) {
+        uint64_t u = x->blocks[0] | (x->numBlocksUsed > 1 ? (uint64_t)x->blocks[1] << 32 : 0);
+        uint64_t v = y->blocks[0] | (y->numBlocksUsed > 1 ? (uint64_t)y->blocks[1] << 32 : 0);
+        return createFromWordBigInt(binaryGcdWord(u, v), 1);
+    }
+
+    unsigned int n = x->numBlocksUsed > y->numBlocksUsed ? x->numBlocksUsed : y->numBlocksUsed;
+    struct BigInt *a = createWithCapacityBigInt(n);
+    struct BigInt *b = createWithCapacityBigInt(n);
+    struct BigInt *a2 = createWithCapacityBigInt(n);
+    struct BigInt *b2 = createWithCapacityBigInt(n);
+    struct BigInt *temp;
+    int64_t cof[4];
+
+    useBlocksBigInt(a, x->numBlocksUsed);
+    memcpy(a->blocks, x->blocks, x->numBlocksUsed * sizeof(uint32_t));
+    useBlocksBigInt(b, y->numBlocksUsed);
+    memcpy(b->blocks, y->blocks, y->numBlocksUsed * sizeof(uint32_t));
+
+    while (1) {
+        if (compareAbsoluteBigInt(a, b) < 0) {
+            temp = a; a = b; b = temp;
+        }
+
+        if (isZeroBigInt(b)) {
+            break;
         }
 
-        replaceBigInt(&r, subtractBigInt(u, w));
-//        printf("r: "); printBigInt(r); printf("\n");
+        if (a->numBlocksUsed <= 2) {
+            uint64_t u = a->blocks[0] | (a->numBlocksUsed > 1 ? (uint64_t)a->blocks[1] << 32 : 0);
+            uint64_t v = b->blocks[0] | (b->numBlocksUsed > 1 ? (uint64_t)b->blocks[1] << 32 : 0);
+            u = binaryGcdWord(u, v);
+            useBlocksBigInt(a, 2);
+            a->blocks[0] = (uint32_t)u;
+            a->blocks[1] = u >> 32;
+            a->numBlocksUsed = u >> 32 ? 2 : 1;
+            break;
+        }
+
+        if (b->numBlocksUsed >= HALF_GCD_THRESHOLD) {
+            struct BigIntMatrix m;
+            freeBigInt(a2);
+            freeBigInt(b2);
+            halfGcdBigInt(a, b, &m);
+            applyInverseBigIntMatrix(&m, a, b, &a2, &b2);
+            freeBigIntMatrix(&m);
+            freeBigInt(a);
+            freeBigInt(b);
+            a = a2;
+            b = b2;
+            a2 = createWithCapacityBigInt(n);
+            b2 = createWithCapacityBigInt(n);
+
+            // Guarantees progress even when the half-GCD can't reduce b
+            if (!isZeroBigInt(b)) {
+                euclidStepBigInt(&a, &b, NULL);
+            }
+            continue;
+        }
 
-        if (j > 0) {
-            temp->blocks[0] = x->blocks[j - 1];
-            replaceBigInt(&u, shiftLeftBigInt(r, 1));
-            replaceBigInt(&u, addBigInt(u, temp));
+        if (lehmerCofactors(a->blocks, a->numBlocksUsed, b->blocks, b->numBlocksUsed, cof) == 0) {
+            // The quotient is too big for Lehmer, so do a full division
+            euclidStepBigInt(&a, &b, NULL);
+            continue;
         }
 
-        freeBigInt(w);
-//        printf("\n");
+        combineLehmerBigInt(a2, a, b, cof[0], cof[1]);
+        combineLehmerBigInt(b2, a, b, cof[2], cof[3]);
+        temp = a; a = a2; a2 = temp;
+        temp = b; b = b2; b2 = temp;
     }
 
-    assert(r->numBlocksUsed == 1);
-    uint32_t rDigit = r->blocks[0];
+    a->sign = 1;
+
+    freeBigInt(b);
+    freeBigInt(a2);
+    freeBigInt(b2);
+    return a;
+}
+
+// Extended Euclid on |x| and |y|, returns g = gcd(x, y) and sets *s so that
+// s |x| + t |y| = g for some t, with |s| <= |y| / g
+// Uses the same Lehmer and half-GCD steps as gcdBigInt, carrying the
+// cofactors of x along with the remainders
+static struct BigInt *extendedGcdCofactorBigInt(struct BigInt *x, struct BigInt *y, struct BigInt **s) {
+    unsigned int n = x->numBlocksUsed > y->numBlocksUsed ? x->numBlocksUsed : y->numBlocksUsed;
+    struct BigInt *a = createWithCapacityBigInt(n);
+    struct BigInt *b = createWithCapacityBigInt(n);
+    struct BigInt *a2 = createWithCapacityBigInt(n);
+    struct BigInt *b2 = createWithCapacityBigInt(n);
+    struct BigInt *s0 = createWithCapacityBigInt(n + 1);
+    struct BigInt *s1 = createWithCapacityBigInt(n + 1);
+    struct BigInt *s2 = createWithCapacityBigInt(n + 1);
+    struct BigInt *s3 = createWithCapacityBigInt(n + 1);
+    struct BigInt *temp;
+    int64_t cof[4];
+
+    // Invariant: a = s0 |x| + t0 |y| and b = s1 |x| + t1 |y|
+    useBlocksBigInt(a, x->numBlocksUsed);
+    memcpy(a->blocks, x->blocks, x->numBlocksUsed * sizeof(uint32_t));
+    useBlocksBigInt(b, y->numBlocksUsed);
+    memcpy(b->blocks, y->blocks, y->numBlocksUsed * sizeof(uint32_t));
+    useBlocksBigInt(s0, 1);
+    s0->blocks[0] = 1;
+    useBlocksBigInt(s1, 1);
+    s1->blocks[0] = 0;
+
+    while (!isZeroBigInt(b)) {
+        if (compareAbsoluteBigInt(a, b) < 0) {
+            temp = a; a = b; b = temp;
+            temp = s0; s0 = s1; s1 = temp;
+        }
+
+        if (b->numBlocksUsed >= HALF_GCD_THRESHOLD) {
+            struct BigIntMatrix m;
+            freeBigInt(a2);
+            freeBigInt(b2);
+            freeBigInt(s2);
+            freeBigInt(s3);
+            halfGcdBigInt(a, b, &m);
+            applyInverseBigIntMatrix(&m, a, b, &a2, &b2);
+            inverseTimesBigIntMatrix(&m, s0, s1, &s2, &s3);
+            freeBigIntMatrix(&m);
+
+            temp = a; a = a2; a2 = temp;
+            temp = b; b = b2; b2 = temp;
+            temp = s0; s0 = s2; s2 = temp;
+            temp = s1; s1 = s3; s3 = temp;
+        }
+
+        if (isZeroBigInt(b)) {
+            break;
+        }
+
+        if (lehmerCofactors(a->blocks, a->numBlocksUsed, b->blocks, b->numBlocksUsed, cof) == 0) {
+            struct BigIntPair *pair = divideBigInt(a, b);
+            replaceBigInt(&pair->x, multiplyBigInt(pair->x, s1));
+            replaceBigInt(&pair->x, subtractBigInt(s0, pair->x));
+
+            freeBigInt(a);
+            a = b;
+            b = pair->y;
+            freeBigInt(s0);
+            s0 = s1;
+            s1 = pair->x;
+            free(pair);
+            continue;
+        }
 
-    assert(rDigit < y);
-    q->sign = x->sign;
-    if (x->sign == -1 && rDigit != 0) {
-        temp->blocks[0] = 1;
-        replaceBigInt(&q, subtractBigInt(q, temp));
-        rDigit = y - rDigit;
+        combineLehmerBigInt(a2, a, b, cof[0], cof[1]);
+        combineLehmerBigInt(b2, a, b, cof[2], cof[3]);
+        combineCofactorsBigInt(s2, s0, s1, cof[0], cof[1]);
+        combineCofactorsBigInt(s3, s0, s1, cof[2], cof[3]);
+        temp = a; a = a2; a2 = temp;
+        temp = b; b = b2; b2 = temp;
+        temp = s0; s0 = s2; s2 = temp;
+        temp = s1; s1 = s3; s3 = temp;
     }
- 
-    freeBigInt(yBig);
-    freeBigInt(temp);
-    freeBigInt(u);
-    freeBigInt(r);
 
-    return createBigIntDigitPair(q, rDigit);
+    a->sign = 1;
+    *s = s0;
+
+    freeBigInt(b);
+    freeBigInt(a2);
+    freeBigInt(b2);
+    freeBigInt(s1);
+    freeBigInt(s2);
+    freeBigInt(s3);
+    return a;
 }
-struct BigIntPair *divideBigInt(struct BigInt *x, struct BigInt *y) {
-    validateBigInt(x);
-    validateBigInt(y);
-    assert(!isZeroBigInt(y));
 
-    int sign = x->sign * y->sign;
-    int cmp = compareAbsoluteBigInt(x, y);
+// Returns g = gcd(x, y) and sets *s and *t (when not NULL) to Bezout
+// coefficients with s x + t y = g
+struct BigInt *extendedGcdBigInt(struct BigInt *x, struct BigInt *y, struct BigInt **s, struct BigInt **t) {
+    checkBigInt(x);
+    checkBigInt(y);
 
-    if (isZeroBigInt(x)) {
-        return createBigIntPair(createBigInt(0), createBigInt(0));
-    } else if (cmp == 0) {
-        struct BigInt *q = createBigInt(1);
-        q->sign = sign;
-        return createBigIntPair(q, createBigInt(0));
-    } else if (cmp == -1) {
-        if (sign == 1) {
-            struct BigInt *r = copyBigInt(x);
-            r->sign = 1;
-            return createBigIntPair(createBigInt(0), r);
+    struct BigInt *cofactor;
+    struct BigInt *g = extendedGcdCofactorBigInt(x, y, &cofactor);
+
+    if (t != NULL) {
+        if (isZeroBigInt(y)) {
+            *t = createBigInt(0);
         } else {
-            struct BigInt *q = createBigInt(1);
-            q->sign = -1;
+            // t = (g - s |x|) / y, which is exact
+            struct BigInt *temp = multiplyBigInt(cofactor, x);
+            if (x->sign == -1) {
+                flipSignBigInt(temp);
+            }
+            replaceBigInt(&temp, subtractBigInt(g, temp));
 
-            int xSign = x->sign;
-            int ySign = y->sign;
-            x->sign = 1;
-            y->sign = 1;
-            struct BigInt *r = subtractBigInt(y, x);
-            x->sign = ySign;
-            y->sign = ySign;
+            struct BigIntPair *pair = divideBigInt(temp, y);
+            assert(isZeroBigInt(pair->y));
+            *t = pair->x;
+            freeBigInt(pair->y);
+            free(pair);
+            freeBigInt(temp);
+        }
+    }
 
-            return createBigIntPair(q, r);
+    if (s != NULL) {
+        if (x->sign == -1 && !isZeroBigInt(cofactor)) {
+            flipSignBigInt(cofactor);
         }
+        *s = cofactor;
+    } else {
+        freeBigInt(cofactor);
     }
 
-    uint32_t d = 1;
-    if (y->blocks[y->numBlocksUsed - 1] < UINT32_MAX / 2 + 1) {
-        d = UINT32_MAX / (y->blocks[y->numBlocksUsed - 1] + 1) + 1;
+    return g;
+}
+
+// Returns the inverse of x modulo m (m > 0) in [0, m), or NULL if x and m
+// aren't coprime
+struct BigInt *modInverseBigInt(struct BigInt *x, struct BigInt *m) {
+    checkBigInt(x);
+    checkBigInt(m);
+    assert(m->sign == 1 && !isZeroBigInt(m));
+
+    // Reduce x first so the cofactors stay below m
+    struct BigIntPair *pair = divideBigInt(x, m);
+    struct BigInt *cofactor;
+    struct BigInt *g = extendedGcdCofactorBigInt(pair->y, m, &cofactor);
+    freeBigIntPair(pair);
+
+    int isUnit = g->numBlocksUsed == 1 && g->blocks[0] == 1;
+    freeBigInt(g);
+    if (!isUnit) {
+        freeBigInt(cofactor);
+        return NULL;
     }
-    struct BigInt *temp = createBigInt(d);
-    x = multiplyBigInt(x, temp);
-    y = multiplyBigInt(y, temp);
-    x->sign = 1;
-    y->sign = 1;
 
-//    printf("d: %u\n", d);
-//    printf("x: "); printBigInt(x); printf("\n");
-//    printf("y: "); printBigInt(y); printf("\n");
+    pair = divideBigInt(cofactor, m);
+    struct BigInt *out = pair->y;
+    freeBigInt(pair->x);
+    free(pair);
+    freeBigInt(cofactor);
+    return out;
+}
 
-    unsigned int xBlocks = x->numBlocksUsed;
-    unsigned int yBlocks = y->numBlocksUsed;
-    unsigned int n = yBlocks;
-    unsigned int m = xBlocks - n;
+// Ranges of at most this many odd numbers are multiplied one factor at a time
+#ifndef FACTORIAL_LEAF_SIZE
+#define FACTORIAL_LEAF_SIZE 16
+#endif
+
+// Product of the odd numbers in [lo, hi] (both odd, lo <= hi), multiplied as
+// a balanced product tree so the big multiplications have equal-sized operands
+static struct BigInt *oddProductBigInt(uint32_t lo, uint32_t hi) {
+    uint32_t count = (hi - lo) / 2 + 1;
+
+    if (count <= FACTORIAL_LEAF_SIZE) {
+        struct BigInt *out = createBigInt(1);
+        uint64_t acc = 1;
+        for (uint64_t i = lo; i <= hi; i += 2) {
+            if (acc * i > UINT32_MAX) {
+                multiplyByDigitToBigInt(out, out, (uint32_t)acc);
+                acc = 1;
+            }
+            acc *= i;
+        }
+        multiplyByDigitToBigInt(out, out, (uint32_t)acc);
+        return out;
+    }
 
-    struct BigInt *q = createBigInt(0);
-    struct BigInt *u = shiftRightBigInt(x, m);
-    struct BigInt *w;
-    struct BigInt *r = createBigInt(0);
+    uint32_t mid = lo + 2 * (count / 2);
+    struct BigInt *out = oddProductBigInt(lo, mid - 2);
+    struct BigInt *high = oddProductBigInt(mid, hi);
+    replaceBigInt(&out, multiplyBigInt(out, high));
+    freeBigInt(high);
 
-    uint32_t tempBlock;
+    return out;
+}
 
-    uint32_t un;
-    uint32_t un1;
+// Returns n!, by Luschny's split recursive algorithm: n! is 2^(n - popcount(n))
+// times its odd part, and the odd part is the product over k of L_k^(k + 1),
+// where L_k is the product of the odd numbers in (n / 2^(k + 1), n / 2^k].
+// Each L_k comes from a product tree, and the powers are built up by
+// multiplying a running product of the L_k into the result
+struct BigInt *factorialBigInt(uint32_t n) {
+    struct BigInt *out = createBigInt(1);
+    if (n < 2) {
+        return out;
+    }
 
-    unsigned int j;
-    for (unsigned int i = 0; i < m + 1; i++) {
-        j = m - i;
+    unsigned int top = 31 - leadingZerosBlock(n);
+    struct BigInt *p = createBigInt(1);
+    for (unsigned int k = top + 1; k > 0; k--) {
+        uint32_t lo = n >> k;
+        uint32_t hi = n >> (k - 1);
+
+        // Odd numbers in (lo, hi]
+        uint32_t first = (lo + 1) | 1;
+        uint32_t last = (hi - 1) | 1;
+        if (first <= last) {
+            struct BigInt *l = oddProductBigInt(first, last);
+            multiplyToBigInt(p, p, l);
+            freeBigInt(l);
+        }
 
-        if (u->numBlocksUsed < n) {
-            un = 0;
-            un1 = 0;
-        } else if (u->numBlocksUsed == n) {
-            un = 0;
-            un1 = u->blocks[n - 1];
-        } else {
-            un = u->blocks[n];
-            un1 = u->blocks[n - 1];
+        if (!(p->numBlocksUsed == 1 && p->blocks[0] == 1)) {
+            multiplyToBigInt(out, out, p);
         }
+    }
+    freeBigInt(p);
 
-//        printf("un: %u\n", un);
-//        printf("un1: %u\n", un1);
-//        printf("yn1: %u\n", y->blocks[n - 1]);
+    unsigned int twos = n;
+    for (uint32_t m = n; m != 0; m &= m - 1) {
+        twos--;
+    }
+    replaceBigInt(&out, shiftLeftBitsBigInt(out, twos));
 
-        if (un == y->blocks[n - 1]) {
-            tempBlock = UINT32_MAX;
-        } else {
-            tempBlock = ((uint64_t)un * ((uint64_t)UINT32_MAX + 1) + un1) / y->blocks[n - 1];
+    return out;
+}
+
+// Product of n factors as a balanced product tree, n > 0
+// Factors are combined in pairs while the product fits in a block
+static struct BigInt *productTreeBigInt(uint32_t *factors, unsigned int n) {
+    if (n <= FACTORIAL_LEAF_SIZE) {
+        struct BigInt *out = createBigInt(1);
+        uint64_t acc = 1;
+        for (unsigned int i = 0; i < n; i++) {
+            if (acc * factors[i] > UINT32_MAX) {
+                multiplyByDigitToBigInt(out, out, (uint32_t)acc);
+                acc = 1;
+            }
+            acc *= factors[i];
         }
+        multiplyByDigitToBigInt(out, out, (uint32_t)acc);
+        return out;
+    }
 
-//        printf("tempBlock: %u\n", tempBlock);
+    struct BigInt *out = productTreeBigInt(factors, n / 2);
+    struct BigInt *high = productTreeBigInt(factors + n / 2, n - n / 2);
+    replaceBigInt(&out, multiplyBigInt(out, high));
+    freeBigInt(high);
 
-        temp->blocks[0] = tempBlock;
-        w = multiplyBigInt(temp, y);
+    return out;
+}
 
-//        printf("w: "); printBigInt(w); printf("\n");
-//        printf("temp: "); printBigInt(temp); printf("\n");
+// Returns the primes up to n, by the sieve of Eratosthenes over the odd
+// numbers only (one bit each), and stores how many there are in count. The
+// caller frees the array
+// Returns NULL if the sieve can't be allocated
+static uint32_t *primesUpTo(uint32_t n, size_t *count) {
+    // Bit i stands for 2i + 1
+    size_t numBits = (size_t)n / 2 + 1;
+    uint32_t *composite = allocBigInt((numBits + 31) / 32 * sizeof(uint32_t));
+    if (composite == NULL) {
+        return NULL;
+    }
+    memset(composite, 0, (numBits + 31) / 32 * sizeof(uint32_t));
 
-        while (compareAbsoluteBigInt(w, u) == 1) {
-            tempBlock--;
-            replaceBigInt(&w, subtractBigInt(w, y));
+    *count = n >= 2 ? 1 : 0;
+    for (uint64_t i = 3; i <= n; i += 2) {
+        if (composite[i / 64] >> (i / 2 % 32) & 1) {
+            continue;
         }
-
-        if (tempBlock != 0) {
-            useBlocksBigInt(q, j + 1);
+        (*count)++;
+        for (uint64_t j = i * i; j <= n; j += 2 * i) {
+            composite[j / 64] |= UINT32_C(1) << (j / 2 % 32);
         }
+    }
+
+    uint32_t *primes = allocBigInt((*count > 0 ? *count : 1) * sizeof(uint32_t));
+    if (primes == NULL) {
+        free(composite);
+        return NULL;
+    }
 
-        if (j < q->numBlocksUsed) {
-            q->blocks[j] = tempBlock;
+    size_t k = 0;
+    if (n >= 2) {
+        primes[k++] = 2;
+    }
+    for (uint64_t i = 3; i <= n; i += 2) {
+        if (!(composite[i / 64] >> (i / 2 % 32) & 1)) {
+            primes[k++] = i;
         }
+    }
+
+    free(composite);
+    return primes;
+}
 
-        replaceBigInt(&r, subtractBigInt(u, w));
+// Exponent of the prime p in n!, by Legendre's formula (sum of n / p^i)
+static uint64_t legendreExponent(uint32_t n, uint32_t p) {
+    uint64_t e = 0;
+    for (uint64_t q = n / p; q > 0; q /= p) {
+        e += q;
+    }
+    return e;
+}
 
-        if (j > 0) {
-            temp->blocks[0] = x->blocks[j - 1];
-            replaceBigInt(&u, shiftLeftBigInt(r, 1));
-            replaceBigInt(&u, addBigInt(u, temp));
+// Returns p^e, by repeated squaring
+static struct BigInt *powerDigitBigInt(uint32_t p, uint64_t e) {
+    struct BigInt *out = createBigInt(1);
+    for (unsigned int bit = 64; bit > 0; bit--) {
+        if (!(out->numBlocksUsed == 1 && out->blocks[0] == 1)) {
+            replaceBigInt(&out, squareBigInt(out));
+        }
+        if (e >> (bit - 1) & 1) {
+            multiplyByDigitToBigInt(out, out, p);
         }
+    }
+    return out;
+}
 
-        freeBigInt(w);
+// Product of the n BigInts x[0..n) as a balanced product tree, n > 0
+static struct BigInt *productTreeOfBigInts(struct BigInt **x, size_t n) {
+    if (n == 1) {
+        return copyBigInt(x[0]);
     }
 
-//    printf("r: "); printBigInt(r); printf("\n");
-//    printf("q: "); printBigInt(q); printf("\n");
+    struct BigInt *out = productTreeOfBigInts(x, n / 2);
+    struct BigInt *high = productTreeOfBigInts(x + n / 2, n - n / 2);
+    replaceBigInt(&out, multiplyBigInt(out, high));
+    freeBigInt(high);
 
-    q->sign = sign;
-    if (sign == -1 && !isZeroBigInt(r)) {
-        temp->blocks[0] = 1;
-        replaceBigInt(&q, subtractBigInt(q, temp));
-        replaceBigInt(&r, subtractBigInt(y, r));
+    return out;
+}
+
+// Returns the product of p^exponents[i] over the given primes. Primes to the
+// first power are multiplied as a product tree of blocks, and higher powers
+// are each built by squaring and then multiplied as a second product tree
+static struct BigInt *primePowerProductBigInt(uint32_t *primes, uint64_t *exponents, size_t numPrimes) {
+    uint32_t *factors = allocBigInt((numPrimes > 0 ? numPrimes : 1) * sizeof(uint32_t));
+    struct BigInt **powers = allocBigInt((numPrimes > 0 ? numPrimes : 1) * sizeof(struct BigInt*));
+    size_t numFactors = 0;
+    size_t numPowers = 0;
+    for (size_t i = 0; i < numPrimes; i++) {
+        if (exponents[i] == 1) {
+            factors[numFactors++] = primes[i];
+        } else if (exponents[i] > 1) {
+            powers[numPowers++] = powerDigitBigInt(primes[i], exponents[i]);
+        }
     }
 
-    struct BigIntDigitPair *pair = divideByDigitBigInt(r, d);
-    assert(pair->y == 0);
-    replaceBigInt(&r, pair->x);
+    struct BigInt *out = numFactors > 0 ? productTreeBigInt(factors, numFactors) : createBigInt(1);
+    if (numPowers > 0) {
+        struct BigInt *product = productTreeOfBigInts(powers, numPowers);
+        replaceBigInt(&out, multiplyBigInt(out, product));
+        freeBigInt(product);
+    }
+
+    for (size_t i = 0; i < numPowers; i++) {
+        freeBigInt(powers[i]);
+    }
+    free(powers);
+    free(factors);
+    return out;
+}
 
+// Returns n choose k as n (n - 1) ... (n - k + 1) / k!, for small k, where
+// building the two products costs less than sieving up to n
+static struct BigInt *binomialByDivisionBigInt(uint32_t n, uint32_t k) {
+    struct BigInt *out = fallingFactorialBigInt(n, k);
+    struct BigInt *factorial = factorialBigInt(k);
+
+    struct BigIntPair *pair = divideBigInt(out, factorial);
+    assert(isZeroBigInt(pair->y));
+    replaceBigInt(&out, pair->x);
+    pair->x = NULL;
+    freeBigInt(pair->y);
     free(pair);
-    freeBigInt(temp);
-    freeBigInt(x);
-    freeBigInt(y);
-    freeBigInt(u);
 
-    return createBigIntPair(q, r);
+    freeBigInt(factorial);
+    return out;
 }
 
-struct BigInt *gcdBigInt(struct BigInt *x, struct BigInt *y) {
-    struct BigInt *u = copyBigInt(x);
-    struct BigInt *v = copyBigInt(y);
-    u->sign = 1;
-    v->sign = 1;
+// Returns n! / (k[0]! k[1]! ... k[m - 1]!) where n = k[0] + ... + k[m - 1]
+// (which must fit in a uint32_t), from the exponent of each prime p <= n,
+// which is Legendre(n, p) minus the sum of Legendre(k[i], p). No factorial is
+// ever built and nothing needs dividing
+// If there isn't room for the sieve, it's built up as a product of binomials
+// (k[0] + ... + k[i] choose k[i]) instead
+struct BigInt *multinomialBigInt(uint32_t *k, unsigned int m) {
+    uint64_t sum = 0;
+    for (unsigned int i = 0; i < m; i++) {
+        sum += k[i];
+    }
+    assert(sum <= UINT32_MAX);
+    uint32_t n = sum;
+
+    size_t numPrimes;
+    uint32_t *primes = primesUpTo(n, &numPrimes);
+    if (primes == NULL) {
+        struct BigInt *out = createBigInt(1);
+        uint32_t total = 0;
+        for (unsigned int i = 0; i < m; i++) {
+            total += k[i];
+            struct BigInt *binomial = binomialByDivisionBigInt(total, k[i] < total - k[i] ? k[i] : total - k[i]);
+            multiplyToBigInt(out, out, binomial);
+            freeBigInt(binomial);
+        }
+        return out;
+    }
 
-    struct BigIntPair *pair;
+    uint64_t *exponents = allocBigInt((numPrimes > 0 ? numPrimes : 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < numPrimes; i++) {
+        exponents[i] = legendreExponent(n, primes[i]);
+        for (unsigned int j = 0; j < m; j++) {
+            exponents[i] -= legendreExponent(k[j], primes[i]);
+        }
+    }
+
+    struct BigInt *out = primePowerProductBigInt(primes, exponents, numPrimes);
+    free(exponents);
+    free(primes);
+    return out;
+}
+
+// Binomials n choose k with min(k, n - k) below n / BINOMIAL_DIVISION_RATIO
+// are computed as a falling factorial over k!, without sieving up to n (the
+// division makes that slower once k is more than about n / 100 to n / 500)
+#ifndef BINOMIAL_DIVISION_RATIO
+#define BINOMIAL_DIVISION_RATIO 256
+#endif
+
+// Returns n choose k, zero if k > n
+struct BigInt *binomialBigInt(uint32_t n, uint32_t k) {
+    if (k > n) {
+        return createBigInt(0);
+    }
+
+    if (n - k < k) {
+        k = n - k;
+    }
+    if (k < n / BINOMIAL_DIVISION_RATIO) {
+        return binomialByDivisionBigInt(n, k);
+    }
+
+    uint32_t parts[2] = {k, n - k};
+    return multinomialBigInt(parts, 2);
+}
+
+// Returns n (n - 1) ... (n - k + 1), the product of the top k factors of n!
+// (zero if k > n), as a product tree over the factors
+struct BigInt *fallingFactorialBigInt(uint32_t n, uint32_t k) {
+    if (k > n) {
+        return createBigInt(0);
+    }
+    if (k == 0) {
+        return createBigInt(1);
+    }
+
+    uint32_t *factors = allocBigInt((size_t)k * sizeof(uint32_t));
+    for (uint32_t i = 0; i < k; i++) {
+        factors[i] = n - i;
+    }
+
+    struct BigInt *out = productTreeBigInt(factors, k);
+    free(factors);
+    return out;
+}
+
+// Decimal conversion works on chunks of 9 digits (base 10^9), splitting
+// numbers in halves around cached powers (10^9)^(2^k), so converting takes
+// O(M(n) log n) instead of quadratic time
+#define DECIMAL_CHUNK 1000000000
+#define DECIMAL_CHUNK_DIGITS 9
+
+// Below this many blocks (or chunks), convert one chunk at a time
+#ifndef DECIMAL_CONVERSION_THRESHOLD
+#define DECIMAL_CONVERSION_THRESHOLD 32
+#endif
+
+static struct BigInt *decimalPowers[32];
+static unsigned int numDecimalPowers = 0;
+
+// Returns (10^9)^(2^level), which is computed once and kept for the life of
+// the program (so it comes from malloc, not whatever allocator is current)
+static struct BigInt *decimalPowerBigInt(unsigned int level) {
+    assert(level < 32);
+
+    struct BigIntAllocator *allocator = currentAllocator;
+    currentAllocator = &mallocAllocator;
+    size_t live = liveAllocations; // The powers are never released
+
+    if (numDecimalPowers == 0) {
+        decimalPowers[0] = createBigInt(DECIMAL_CHUNK);
+        numDecimalPowers = 1;
+    }
+
+    while (numDecimalPowers <= level) {
+        decimalPowers[numDecimalPowers] = squareBigInt(decimalPowers[numDecimalPowers - 1]);
+        numDecimalPowers++;
+    }
+
+    liveAllocations = live;
+    currentAllocator = allocator;
+    return decimalPowers[level];
+}
+
+// Converts n base 10^9 chunks (least significant first) to a BigInt
+static struct BigInt *fromDecimalChunksBigInt(uint32_t *chunks, unsigned int n) {
+    if (n <= DECIMAL_CONVERSION_THRESHOLD) {
+        // Each chunk is below 2^32, so n chunks fit in n blocks
+        struct BigInt *out = createWithCapacityBigInt(n + 1);
+        for (unsigned int i = n; i > 0; i--) {
+            out->numBlocksUsed = multiplyAddDigitBlocks(out->blocks, out->numBlocksUsed, DECIMAL_CHUNK, chunks[i - 1]);
+        }
+        return out;
+    }
+
+    // Split so that the low half is 2^level chunks, with 2^level < n <= 2^(level + 1)
+    unsigned int level = 0;
+    while ((2u << level) < n) {
+        level++;
+    }
+    unsigned int half = 1u << level;
+
+    struct BigInt *out = fromDecimalChunksBigInt(chunks + half, n - half);
+    replaceBigInt(&out, multiplyBigInt(out, decimalPowerBigInt(level)));
 
-    while (!isZeroBigInt(v)) {
-        pair = divideBigInt(u, v);
-        replaceBigInt(&u, v);
-        v = pair->y;
+    struct BigInt *low = fromDecimalChunksBigInt(chunks, half);
+    replaceBigInt(&out, addBigInt(out, low));
+    freeBigInt(low);
+
+    return out;
+}
+
+// Writes x (non-negative and less than (10^9)^(2^level)) to out as exactly
+// 9 * 2^level decimal digits, padded with leading zeros
+static void toDecimalBigInt(struct BigInt *x, unsigned int level, char *out) {
+    size_t width = (size_t)DECIMAL_CHUNK_DIGITS << level;
+
+    if (level == 0 || x->numBlocksUsed <= DECIMAL_CONVERSION_THRESHOLD) {
+        unsigned int n = x->numBlocksUsed;
+        uint32_t *q = allocBigInt(n * sizeof(uint32_t));
+        memcpy(q, x->blocks, n * sizeof(uint32_t));
+
+        size_t pos = width;
+        while (n > 1 || q[0] != 0) {
+            uint32_t chunk = divideByDigitBlocks(q, q, n, DECIMAL_CHUNK);
+            n = trimLengthBlocks(q, n);
+
+            assert(pos >= DECIMAL_CHUNK_DIGITS);
+            for (int i = 0; i < DECIMAL_CHUNK_DIGITS; i++) {
+                out[--pos] = '0' + chunk % 10;
+                chunk /= 10;
+            }
+        }
+        memset(out, '0', pos);
+
+        free(q);
+        return;
+    }
 
-        freeBigInt(pair->x);
-        free(pair);
+    struct BigInt *power = decimalPowerBigInt(level - 1);
+    if (compareAbsoluteBigInt(x, power) < 0) {
+        memset(out, '0', width / 2);
+        toDecimalBigInt(x, level - 1, out + width / 2);
+        return;
     }
 
-    freeBigInt(v);
-    return u;
+    struct BigIntPair *pair = divideBigInt(x, power);
+    toDecimalBigInt(pair->x, level - 1, out);
+    toDecimalBigInt(pair->y, level - 1, out + width / 2);
+    freeBigIntPair(pair);
 }
 
 void printBigIntDecimal(struct BigInt *x) {
-    validateBigInt(x);
+    checkBigInt(x);
 
     if (x->sign == -1) {
         printf("-");
@@ -681,33 +3725,320 @@ void printBigIntDecimal(struct BigInt *x) {
         return;
     }
 
-    unsigned int approxDigits = 10 * x->numBlocksUsed;
-    char *digits = malloc(approxDigits * sizeof(char));
+    struct BigInt *magnitude = copyBigInt(x);
+    magnitude->sign = 1; // We already printed the negative sign if negative
+
+    // Pick level so that magnitude < (10^9)^(2^level), from bit lengths so that
+    // only the powers the split uses get built. That power is the square of a
+    // b bit one, so it's at least 2^(2 b - 2), and at worst level is one more
+    // than needed and the top half of the digits is zeros
+    unsigned int level = 0;
+    if (compareAbsoluteBigInt(magnitude, decimalPowerBigInt(0)) >= 0) {
+        unsigned int bits = bitLengthBigInt(magnitude);
+        level = 1;
+        while (bits > 2 * bitLengthBigInt(decimalPowerBigInt(level - 1)) - 2) {
+            level++;
+        }
+    }
+
+    size_t width = (size_t)DECIMAL_CHUNK_DIGITS << level;
+    char *digits = allocBigInt(width + 1);
+    toDecimalBigInt(magnitude, level, digits);
+    digits[width] = '\0';
+
+    size_t start = 0;
+    while (digits[start] == '0') {
+        start++;
+    }
+    printf("%s", digits + start);
+
+    free(digits);
+    freeBigInt(magnitude);
+}
+
+// Binary format: one sign byte (0 for non-negative, 1 for negative), the limb
+// count as a little-endian uint32, then the limbs as little-endian uint32s
+// Values round-trip exactly, with no base conversion
+
+size_t serializedSizeBigInt(struct BigInt *x) {
+    return 5 + 4 * (size_t)x->numBlocksUsed;
+}
+
+static void storeWordBytes(unsigned char *out, uint32_t x) {
+    out[0] = x;
+    out[1] = x >> 8;
+    out[2] = x >> 16;
+    out[3] = x >> 24;
+}
+
+static uint32_t loadWordBytes(unsigned char *x) {
+    return (uint32_t)x[0] | (uint32_t)x[1] << 8 | (uint32_t)x[2] << 16 | (uint32_t)x[3] << 24;
+}
+
+// Writes x to buffer, which must have room for serializedSizeBigInt(x) bytes
+// Returns the number of bytes written
+size_t serializeBigInt(struct BigInt *x, unsigned char *buffer) {
+    checkBigInt(x);
+
+    buffer[0] = x->sign == -1 ? 1 : 0;
+    storeWordBytes(buffer + 1, x->numBlocksUsed);
+    for (unsigned int i = 0; i < x->numBlocksUsed; i++) {
+        storeWordBytes(buffer + 5 + 4 * (size_t)i, x->blocks[i]);
+    }
+
+    return serializedSizeBigInt(x);
+}
 
-    struct BigInt *q = copyBigInt(x);
-    q->sign = 1; // We already printed the negative sign if negative
-    struct BigIntDigitPair *pair;
-    unsigned int actualDigits = 0;
-    while(!isZeroBigInt(q)) {
-        pair = divideByDigitBigInt(q, 10);
-        assert(pair->y < 10);
+// Checks a header and limbs read from outside, since they can't be trusted
+// to be in canonical form
+static int isCanonicalSerializedBigInt(unsigned char sign, uint32_t numBlocks, uint32_t *blocks) {
+    if (sign > 1 || numBlocks == 0) {
+        return 0;
+    }
 
-        digits[actualDigits] =  pair->y + '0';
+    int isZero = numBlocks == 1 && blocks[0] == 0;
+    return (numBlocks == 1 || blocks[numBlocks - 1] != 0) && !(isZero && sign == 1);
+}
 
-        replaceBigInt(&q, pair->x);
-        free(pair);
+// Reads a BigInt from the first size bytes of buffer, and sets *used (if not
+// NULL) to the number of bytes it took up
+// Returns NULL if the buffer is truncated, doesn't hold a valid BigInt, or
+// there isn't memory for it
+struct BigInt *deserializeBigInt(unsigned char *buffer, size_t size, size_t *used) {
+    if (size < 5) {
+        return NULL;
+    }
 
-        actualDigits++;
-        assert(actualDigits <= approxDigits);
+    uint32_t numBlocks = loadWordBytes(buffer + 1);
+    if (numBlocks == 0 || (size - 5) / 4 < numBlocks) {
+        return NULL;
     }
 
-    freeBigInt(q);
+    struct BigInt *out = tryCreateWithCapacityBigInt(numBlocks);
+    if (out == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        out->blocks[i] = loadWordBytes(buffer + 5 + 4 * (size_t)i);
+    }
+    out->numBlocksUsed = numBlocks;
+    out->sign = buffer[0] == 1 ? -1 : 1;
 
-    for (unsigned int i = 0; i < actualDigits; i++) {
-        printf("%c", digits[actualDigits - i - 1]);
+    if (!isCanonicalSerializedBigInt(buffer[0], numBlocks, out->blocks)) {
+        freeBigInt(out);
+        return NULL;
     }
 
-    free(digits);
+    if (used != NULL) {
+        *used = 5 + 4 * (size_t)numBlocks;
+    }
+    return out;
+}
+
+// Returns 1 if x was written to file, 0 on a write error
+int writeBigInt(struct BigInt *x, FILE *file) {
+    size_t size = serializedSizeBigInt(x);
+    unsigned char *buffer = allocBigInt(size);
+    serializeBigInt(x, buffer);
+
+    int ok = fwrite(buffer, 1, size, file) == size;
+    free(buffer);
+    return ok;
+}
+
+// Limbs are read from a file this many at a time, into a buffer that only
+// grows as they arrive, so a corrupt limb count can't make us allocate much
+// more than the file actually holds
+#ifndef BIGINT_READ_CHUNK_BLOCKS
+#define BIGINT_READ_CHUNK_BLOCKS 4096
+#endif
+
+// Returns NULL at end of file, if the input doesn't hold a valid BigInt, or if
+// there isn't memory for it
+struct BigInt *readBigInt(FILE *file) {
+    unsigned char header[5];
+    if (fread(header, 1, 5, file) != 5) {
+        return NULL;
+    }
+
+    uint32_t numBlocks = loadWordBytes(header + 1);
+    if (numBlocks == 0) {
+        return NULL;
+    }
+
+    size_t capacity = numBlocks < BIGINT_READ_CHUNK_BLOCKS ? numBlocks : BIGINT_READ_CHUNK_BLOCKS;
+    uint32_t *blocks = allocBigInt(capacity * sizeof(uint32_t));
+    if (blocks == NULL) {
+        return NULL;
+    }
+
+    size_t numRead = 0;
+    while (numRead < numBlocks) {
+        size_t chunk = numBlocks - numRead < BIGINT_READ_CHUNK_BLOCKS ? numBlocks - numRead : BIGINT_READ_CHUNK_BLOCKS;
+        if (numRead + chunk > capacity) {
+            capacity = 2 * capacity < numBlocks ? 2 * capacity : numBlocks;
+            uint32_t *grown = realloc(blocks, capacity * sizeof(uint32_t));
+            if (grown == NULL) {
+                free(blocks);
+                return NULL;
+            }
+            blocks = grown;
+        }
+
+        if (fread(blocks + numRead, 4, chunk, file) != chunk) {
+            free(blocks);
+            return NULL;
+        }
+        numRead += chunk;
+    }
+
+    // Convert each limb from its bytes in place
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        blocks[i] = loadWordBytes((unsigned char *)&blocks[i]);
+    }
+
+    struct BigInt *out = NULL;
+    if (isCanonicalSerializedBigInt(header[0], numBlocks, blocks)) {
+        out = tryCreateWithCapacityBigInt(numBlocks);
+    }
+    if (out != NULL) {
+        memcpy(out->blocks, blocks, numBlocks * sizeof(uint32_t));
+        out->numBlocksUsed = numBlocks;
+        out->sign = header[0] == 1 ? -1 : 1;
+    }
+
+    free(blocks);
+    return out;
+}
+
+// Hex text looks like 0x1f or -0x1f (the 0x is optional on input), and is
+// converted 8 digits per limb
+
+static int hexDigitValue(char c) {
+    if ('0' <= c && c <= '9') {
+        return c - '0';
+    } else if ('a' <= c && c <= 'f') {
+        return c - 'a' + 10;
+    } else if ('A' <= c && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+struct BigInt *createFromHexStringBigInt(char *str) {
+    int sign = 1;
+    if (str[0] == '-') {
+        sign = -1;
+        str++;
+    }
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+    }
+
+    size_t len = strlen(str);
+    assert(len > 0);
+
+    unsigned int numBlocks = (len + 7) / 8;
+    struct BigInt *out = createWithCapacityBigInt(numBlocks);
+    for (unsigned int i = 0; i < numBlocks; i++) {
+        size_t end = len - 8 * (size_t)i;
+        size_t begin = end > 8 ? end - 8 : 0;
+
+        uint32_t block = 0;
+        for (size_t j = begin; j < end; j++) {
+            int digit = hexDigitValue(str[j]);
+            assert(digit >= 0);
+            block = (block << 4) | digit;
+        }
+        out->blocks[i] = block;
+    }
+    out->numBlocksUsed = trimLengthBlocks(out->blocks, numBlocks);
+
+    if (!isZeroBigInt(out)) {
+        out->sign = sign;
+    }
+    return out;
+}
+
+// Returns x in hex as a newly allocated string, which the caller frees
+char *toHexStringBigInt(struct BigInt *x) {
+    checkBigInt(x);
+
+    // Sign, 0x, 8 digits per limb and the terminator
+    char *out = allocBigInt(4 + 8 * (size_t)x->numBlocksUsed);
+    char *cur = out;
+
+    if (x->sign == -1) {
+        *cur++ = '-';
+    }
+    cur += sprintf(cur, "0x%x", x->blocks[x->numBlocksUsed - 1]);
+    for (unsigned int i = x->numBlocksUsed - 1; i > 0; i--) {
+        cur += sprintf(cur, "%08x", x->blocks[i - 1]);
+    }
+
+    return out;
+}
+
+// Returns 1 if x was written to file, 0 on a write error
+int writeHexBigInt(struct BigInt *x, FILE *file) {
+    char *str = toHexStringBigInt(x);
+    int ok = fputs(str, file) >= 0;
+    free(str);
+    return ok;
+}
+
+// Reads a hex number after any leading whitespace, stopping at (and leaving
+// in the stream) the first character that can't continue it
+// Returns NULL at end of file, if there are no digits, or if there isn't
+// memory for them
+struct BigInt *readHexBigInt(FILE *file) {
+    size_t size = 64;
+    size_t len = 0;
+    char *str = allocBigInt(size);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    int c = fgetc(file);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        c = fgetc(file);
+    }
+    if (c == '-') {
+        str[len++] = c;
+        c = fgetc(file);
+    }
+    if (c == '0') {
+        str[len++] = c;
+        c = fgetc(file);
+        if (c == 'x' || c == 'X') {
+            len--;
+            c = fgetc(file);
+        }
+    }
+
+    size_t numDigits = len > 0 && str[len - 1] == '0' ? 1 : 0;
+    while (c != EOF && hexDigitValue(c) >= 0) {
+        if (len + 1 >= size) {
+            size *= 2;
+            char *grown = realloc(str, size);
+            if (grown == NULL) {
+                free(str);
+                return NULL;
+            }
+            str = grown;
+        }
+        str[len++] = c;
+        numDigits++;
+        c = fgetc(file);
+    }
+    if (c != EOF) {
+        ungetc(c, file);
+    }
+    str[len] = '\0';
+
+    struct BigInt *out = numDigits > 0 ? createFromHexStringBigInt(str) : NULL;
+    free(str);
+    return out;
 }
 
 void printBigIntDigitPair(struct BigIntDigitPair *pair) {
@@ -1,11 +1,19 @@
 #ifndef BIGINT_HEADER
 #define BIGINT_HEADER
 
+#include <stdio.h>
+
+// Values of up to BIGINT_INLINE_BLOCKS blocks are stored in inlineBlocks,
+// inside the struct itself, with blocks pointing there (so they don't need a
+// second allocation). Larger values get their blocks from the heap
+#define BIGINT_INLINE_BLOCKS 2
+
 struct BigInt {
     int sign;
     unsigned int numBlocks;
     unsigned int numBlocksUsed;
     uint32_t *blocks;
+    uint32_t inlineBlocks[BIGINT_INLINE_BLOCKS];
 };
 
 struct BigIntPair {
@@ -18,6 +26,24 @@ struct BigIntDigitPair {
     uint32_t y;
 };
 
+// BigInt structs, their heap blocks and Fraction structs are allocated through
+// the current allocator. release is given the same size that was passed to
+// alloc, and memory must go back to the allocator it came from, so
+// setAllocatorBigInt may only be called while nothing is allocated (it asserts
+// this)
+struct BigIntAllocator {
+    void *(*alloc)(void *state, size_t size);
+    void (*release)(void *state, void *ptr, size_t size);
+    void *state;
+};
+
+// A bump allocator for short-lived values: while it's entered, small
+// allocations are carved out of large chunks and releasing them does nothing.
+// Values made inside may still be freed after leaving, and go back to the
+// arena. Resetting it (after leaving) reclaims everything at once, so no value
+// allocated inside may be used after that
+struct BigIntArena;
+
 struct BigInt* createBigInt(uint32_t value);
 struct BigInt* createFromStringBigInt(char *str);
 struct BigIntPair *createBigIntPair(struct BigInt *x, struct BigInt *y);
@@ -28,7 +54,9 @@ void freeBigIntPair(struct BigIntPair *x);
 void freeBigIntDigitPair(struct BigIntDigitPair *x);
 void replaceBigInt(struct BigInt **x, struct BigInt *y);
 
+// Checks x's invariants, exiting with a message if any is broken
 void validateBigInt(struct BigInt *x);
+int isCheckedBuildBigInt();
 int isZeroBigInt(struct BigInt *x);
 void growBigInt(struct BigInt *x);
 void useBlocksBigInt(struct BigInt *x, unsigned int numBlocks);
@@ -41,11 +69,56 @@ int compareBigInt(struct BigInt *x, struct BigInt *y);
 struct BigInt *addBigInt(struct BigInt *x, struct BigInt *y);
 struct BigInt *subtractBigInt(struct BigInt *x, struct BigInt *y);
 struct BigInt *multiplyBigInt(struct BigInt *x, struct BigInt *y);
+struct BigInt *squareBigInt(struct BigInt *x);
+struct BigInt *multiplyByDigitBigInt(struct BigInt *x, uint32_t y);
+void addToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y);
+void subtractToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y);
+void multiplyToBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y);
+void multiplyAddBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y);
+void multiplySubtractBigInt(struct BigInt *dst, struct BigInt *x, struct BigInt *y);
+void multiplyByDigitToBigInt(struct BigInt *dst, struct BigInt *x, uint32_t y);
 struct BigInt *shiftRightBigInt(struct BigInt *x, unsigned int places);
 struct BigInt *shiftLeftBigInt(struct BigInt *x, unsigned int places);
+struct BigInt *shiftRightBitsBigInt(struct BigInt *x, unsigned int bits);
+struct BigInt *shiftLeftBitsBigInt(struct BigInt *x, unsigned int bits);
+unsigned int bitLengthBigInt(struct BigInt *x);
+struct BigInt *packSlotsBigInt(struct BigInt **x, unsigned int n, unsigned int s);
+void unpackSlotsBigInt(struct BigInt *x, unsigned int n, unsigned int s, struct BigInt **out);
+int convolveBigInt(struct BigInt **out, struct BigInt **x, unsigned int xn, struct BigInt **y, unsigned int yn);
 struct BigIntDigitPair *divideByDigitBigInt(struct BigInt *x, uint32_t y);
 struct BigIntPair *divideBigInt(struct BigInt *x, struct BigInt *y);
 struct BigInt *gcdBigInt(struct BigInt *x, struct BigInt *y);
+struct BigInt *extendedGcdBigInt(struct BigInt *x, struct BigInt *y, struct BigInt **s, struct BigInt **t);
+struct BigInt *modInverseBigInt(struct BigInt *x, struct BigInt *m);
+struct BigInt *factorialBigInt(uint32_t n);
+struct BigInt *fallingFactorialBigInt(uint32_t n, uint32_t k);
+struct BigInt *binomialBigInt(uint32_t n, uint32_t k);
+struct BigInt *multinomialBigInt(uint32_t *k, unsigned int m);
+
+unsigned long getAllocationCountBigInt();
+
+void *allocMemoryBigInt(size_t size);
+void releaseMemoryBigInt(void *ptr, size_t size);
+struct BigIntAllocator *getAllocatorBigInt();
+void setAllocatorBigInt(struct BigIntAllocator *allocator);
+struct BigIntAllocator *getMallocAllocatorBigInt();
+struct BigIntAllocator *getPoolAllocatorBigInt();
+void trimPoolBigInt();
+struct BigIntArena *createArenaBigInt();
+void enterArenaBigInt(struct BigIntArena *arena);
+void leaveArenaBigInt(struct BigIntArena *arena);
+void resetArenaBigInt(struct BigIntArena *arena);
+void freeArenaBigInt(struct BigIntArena *arena);
+
+size_t serializedSizeBigInt(struct BigInt *x);
+size_t serializeBigInt(struct BigInt *x, unsigned char *buffer);
+struct BigInt *deserializeBigInt(unsigned char *buffer, size_t size, size_t *used);
+int writeBigInt(struct BigInt *x, FILE *file);
+struct BigInt *readBigInt(FILE *file);
+struct BigInt *createFromHexStringBigInt(char *str);
+char *toHexStringBigInt(struct BigInt *x);
+int writeHexBigInt(struct BigInt *x, FILE *file);
+struct BigInt *readHexBigInt(FILE *file);
 
 void printBigIntDecimal(struct BigInt *x);
 void printBigIntDigitPair(struct BigIntDigitPair *pair);
@@ -0,0 +1,19 @@
+#ifndef CHECKED_HEADER
+#define CHECKED_HEADER
+
+#include "bigint.h"
+
+// Internal to bigint.c and fraction.c: the arithmetic functions only check
+// their arguments with validateBigInt (through checkBigInt) when built with
+// -DBIGINT_CHECKED=1; otherwise the checks are compiled out
+#ifndef BIGINT_CHECKED
+#define BIGINT_CHECKED 0
+#endif
+
+#if BIGINT_CHECKED
+#define checkBigInt(x) validateBigInt(x)
+#else
+#define checkBigInt(x) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+import sys
+from fractions import Fraction as F
+inp=open(sys.argv[1]).read().split("\n"); out=open(sys.argv[2]).read().split("\n")
+def P(s): return [F(t) for t in s.split()]
+def norm(p):
+    while len(p)>1 and p[-1]==0: p=p[:-1]
+    return p or [F(0)]
+def mul(a,b):
+    r=[F(0)]*(len(a)+len(b)-1)
+    for i,x in enumerate(a):
+        if x:
+            for j,y in enumerate(b):
+                if y: r[i+j]+=x*y
+    return r
+def zp(a,b,s):
+    n=max(len(a),len(b)); a=a+[F(0)]*(n-len(a)); b=b+[F(0)]*(n-len(b)); return [x+s*y for x,y in zip(a,b)]
+bad=0;k=0
+for t in range(0,len(inp)-1,2):
+    a,b=P(inp[t]),P(inp[t+1])
+    exp=[mul(a,b),mul(a,a),mul(a,b),zp(a,b,1),zp(a,b,-1),[F(0)],mul(a,b),zp(a,b,1),zp(a,b,-1),mul(a,a)]
+    for i,e in enumerate(exp):
+        line=out[k];k+=1
+        toks=line.split()
+        got=norm([F(x) for x in toks])
+        # canonical form check: no non-reduced printed fraction
+        for x in toks:
+            if "/" in x:
+                n,d=map(int,x.split("/"))
+                import math
+                if math.gcd(n,d)!=1 or d<=1: print("noncanon",t,i,x); bad+=1; break
+        if got!=norm(e): print("MISMATCH pair",t//2,"op",i); bad+=1
+print("pairs",len(inp)//2,"bad",bad)
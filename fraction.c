@@ -5,6 +5,47 @@
 #include <string.h>
 
 #include "fraction.h"
+#include "checked.h"
+
+// In lazy mode, sums and products aren't reduced to lowest terms until they
+// grow past twice their size at the last reduction plus this many blocks
+#ifndef FRACTION_LAZY_THRESHOLD
+#define FRACTION_LAZY_THRESHOLD 8
+#endif
+
+static int lazyFraction = 0;
+
+// Turns lazy mode on or off. Turning it off doesn't reduce the fractions that
+// already exist, but every operation reduces its operands before using them
+void setLazyFraction(int lazy) {
+    lazyFraction = lazy;
+}
+
+int getLazyFraction() {
+    return lazyFraction;
+}
+
+// A denominator of 1 marks an integer (and one that's in lowest terms, even
+// in lazy mode), and takes the integer fast paths below
+int isIntegerFraction(struct Fraction *x) {
+    return x->d->numBlocksUsed == 1 && x->d->blocks[0] == 1;
+}
+
+static unsigned int sizeFraction(struct Fraction *x) {
+    return x->n->numBlocksUsed + x->d->numBlocksUsed;
+}
+
+// Returns n/d, taking ownership of n and d, which must already have the
+// sign on the numerator if reduced is set
+static struct Fraction *createFromBigIntsFraction(struct BigInt *n, struct BigInt *d, int reduced) {
+    struct Fraction *out = allocMemoryBigInt(sizeof(struct Fraction));
+    out->n = n;
+    out->d = d;
+    out->reduced = reduced;
+    out->reducedBlocks = reduced ? sizeFraction(out) : 0;
+
+    return out;
+}
 
 void correctSignFraction(struct Fraction *x) {
     // Keep sign on numerator
@@ -17,32 +58,64 @@ void correctSignFraction(struct Fraction *x) {
 }
 
 struct Fraction *createFraction(struct BigInt *n, struct BigInt *d) {
-    validateBigInt(n);
-    validateBigInt(d);
+    checkBigInt(n);
+    checkBigInt(d);
     assert(!isZeroBigInt(d));
 
-    struct Fraction *f = malloc(sizeof(struct Fraction));
-    struct BigInt *gcd = gcdBigInt(n, d);
+    struct Fraction *f = createFromBigIntsFraction(copyBigInt(n), copyBigInt(d), 0);
+    reduceFraction(f);
+
+    return f;
+}
+
+// Reduces x to lowest terms in place, if it isn't already
+void reduceFraction(struct Fraction *x) {
+    if (x->reduced) {
+        return;
+    }
+
+    if (isIntegerFraction(x)) {
+        correctSignFraction(x);
+        x->reduced = 1;
+        x->reducedBlocks = sizeFraction(x);
+        return;
+    }
+
+    struct BigInt *gcd = gcdBigInt(x->n, x->d);
 
     struct BigIntPair *pair;
 
-    pair = divideBigInt(n, gcd);
+    pair = divideBigInt(x->n, gcd);
     assert(isZeroBigInt(pair->y));
-    f->n = pair->x;
+    replaceBigInt(&x->n, pair->x);
     freeBigInt(pair->y);
     free(pair);
 
-    pair = divideBigInt(d, gcd);
+    pair = divideBigInt(x->d, gcd);
     assert(isZeroBigInt(pair->y));
-    f->d = pair->x;
+    replaceBigInt(&x->d, pair->x);
     freeBigInt(pair->y);
     free(pair);
 
-    correctSignFraction(f);
+    correctSignFraction(x);
 
     freeBigInt(gcd);
 
-    return f;
+    x->reduced = 1;
+    x->reducedBlocks = sizeFraction(x);
+}
+
+// Reduces a lazy result once it has grown enough since its operands were
+// last reduced (reducedBlocks holds their size until then)
+static void reduceIfLargeFraction(struct Fraction *x) {
+    if (sizeFraction(x) > 2 * x->reducedBlocks + FRACTION_LAZY_THRESHOLD) {
+        reduceFraction(x);
+    }
+}
+
+// Returns the larger size at last reduction of x and y, for a lazy result
+static unsigned int maxReducedBlocksFraction(struct Fraction *x, struct Fraction *y) {
+    return x->reducedBlocks > y->reducedBlocks ? x->reducedBlocks : y->reducedBlocks;
 }
 
 struct Fraction *createFromStringFraction(char *nStr, char *dStr) {
@@ -71,9 +144,8 @@ struct Fraction *createFromSingleStringFraction(char *str) {
 }
 
 struct Fraction *copyFraction(struct Fraction *x) {
-    struct Fraction *out = malloc(sizeof(struct Fraction));
-    out->n = copyBigInt(x->n);
-    out->d = copyBigInt(x->d);
+    struct Fraction *out = createFromBigIntsFraction(copyBigInt(x->n), copyBigInt(x->d), x->reduced);
+    out->reducedBlocks = x->reducedBlocks;
 
     return out;
 }
@@ -81,7 +153,7 @@ struct Fraction *copyFraction(struct Fraction *x) {
 void freeFraction(struct Fraction *f) {
     freeBigInt(f->n);
     freeBigInt(f->d);
-    free(f);
+    releaseMemoryBigInt(f, sizeof(struct Fraction));
 }
 
 void replaceFraction (struct Fraction **x, struct Fraction *y) {
@@ -89,21 +161,69 @@ void replaceFraction (struct Fraction **x, struct Fraction *y) {
     *x = y;
 }
 
-// All operations assume that fractions are in simplest form
+// Operations give results in simplest form from operands in simplest form,
+// unless lazy mode is on. Then sums and products are left unreduced (except
+// now and then, see reduceIfLargeFraction), and the results are only reduced
+// when printed, written out, or by reduceFraction
 
 struct Fraction *invertFraction(struct Fraction *x) {
     assert(!isZeroBigInt(x->n));
 
-    struct Fraction *out = malloc(sizeof(struct Fraction));
-    out->n = copyBigInt(x->d);
-    out->d = copyBigInt(x->n);
+    struct Fraction *out = createFromBigIntsFraction(copyBigInt(x->d), copyBigInt(x->n), x->reduced);
+    out->reducedBlocks = x->reducedBlocks;
 
     correctSignFraction(out);
 
     return out;
 }
 
+// n/d = (a d + c b) / (b d), without reducing it
+static struct Fraction *addLazyFraction(struct Fraction *x, struct Fraction *y) {
+    struct BigInt *n = multiplyBigInt(x->n, y->d);
+    multiplyAddBigInt(n, y->n, x->d);
+
+    struct Fraction *out = createFromBigIntsFraction(n, multiplyBigInt(x->d, y->d), 0);
+    out->reducedBlocks = maxReducedBlocksFraction(x, y);
+    reduceIfLargeFraction(out);
+
+    return out;
+}
+
+// x + c for an integer c, which needs no reduction when x is in lowest terms
+// since gcd(a + c b, b) = gcd(a, b)
+static struct Fraction *addIntegerFraction(struct Fraction *x, struct BigInt *c) {
+    struct BigInt *n;
+    if (isIntegerFraction(x)) {
+        // Both are integers, so there's nothing to scale c by
+        n = addBigInt(x->n, c);
+    } else {
+        n = copyBigInt(x->n);
+        multiplyAddBigInt(n, c, x->d);
+    }
+
+    struct Fraction *out = createFromBigIntsFraction(n, copyBigInt(x->d), x->reduced);
+    out->reducedBlocks = x->reduced ? sizeFraction(out) : x->reducedBlocks;
+
+    return out;
+}
+
 struct Fraction *addFraction(struct Fraction *x, struct Fraction *y) {
+    if (!lazyFraction) {
+        reduceFraction(x);
+        reduceFraction(y);
+    }
+
+    if (isIntegerFraction(y)) {
+        return addIntegerFraction(x, y->n);
+    }
+    if (isIntegerFraction(x)) {
+        return addIntegerFraction(y, x->n);
+    }
+
+    if (lazyFraction) {
+        return addLazyFraction(x, y);
+    }
+
     struct BigInt *a = x->n;
     struct BigInt *b = x->d;
     struct BigInt *c = y->n;
@@ -124,12 +244,10 @@ struct Fraction *addFraction(struct Fraction *x, struct Fraction *y) {
     freeBigInt(pair->y);
     free(pair);
 
-    a = multiplyBigInt(a, d1);
-    c = multiplyBigInt(c, b1);
-
-    struct Fraction *out = malloc(sizeof(struct Fraction));
-    out->n = addBigInt(a, c);
-    out->d = multiplyBigInt(b1, d);
+    // n = a d1 + c b1, accumulated in place
+    struct BigInt *n = multiplyBigInt(a, d1);
+    multiplyAddBigInt(n, c, b1);
+    struct Fraction *out = createFromBigIntsFraction(n, multiplyBigInt(b1, d), 0);
 
     replaceBigInt(&gcd, gcdBigInt(out->n, gcd));
 
@@ -145,13 +263,13 @@ struct Fraction *addFraction(struct Fraction *x, struct Fraction *y) {
     freeBigInt(pair->y);
     free(pair);
 
-    freeBigInt(a);
     freeBigInt(b1);
-    freeBigInt(c);
     freeBigInt(d1);
     freeBigInt(gcd);
 
     correctSignFraction(out);
+    out->reduced = 1;
+    out->reducedBlocks = sizeFraction(out);
 
     return out;
 }
@@ -164,7 +282,83 @@ struct Fraction *subtractFraction(struct Fraction *x, struct Fraction *y) {
     return out;
 }
 
+// Sum of x[0..n) over the lcm of their denominators, not reduced
+// Halves are summed recursively so the multiplications stay balanced, and
+// equal denominators (common in practice) are added without a gcd
+static struct Fraction *sumOverLcmFraction(struct Fraction **x, unsigned int n) {
+    if (n == 1) {
+        struct Fraction *out = copyFraction(x[0]);
+        out->reduced = 0;
+        return out;
+    }
+
+    struct Fraction *low = sumOverLcmFraction(x, n / 2);
+    struct Fraction *high = sumOverLcmFraction(x + n / 2, n - n / 2);
+
+    if (compareBigInt(low->d, high->d) == 0) {
+        addToBigInt(low->n, low->n, high->n);
+        freeFraction(high);
+        return low;
+    }
+
+    // lcm = b d1 = d b1, where b1 = b / gcd and d1 = d / gcd
+    struct BigInt *gcd = gcdBigInt(low->d, high->d);
+    struct BigIntPair *pair;
+
+    pair = divideBigInt(low->d, gcd);
+    struct BigInt *b1 = pair->x;
+    freeBigInt(pair->y);
+    free(pair);
+
+    pair = divideBigInt(high->d, gcd);
+    struct BigInt *d1 = pair->x;
+    freeBigInt(pair->y);
+    free(pair);
+
+    multiplyToBigInt(low->n, low->n, d1);
+    multiplyAddBigInt(low->n, high->n, b1);
+    multiplyToBigInt(low->d, low->d, d1);
+
+    freeBigInt(gcd);
+    freeBigInt(b1);
+    freeBigInt(d1);
+    freeFraction(high);
+
+    return low;
+}
+
+// Returns x[0] + ... + x[n - 1], with one reduction at the end instead of one
+// per addition
+struct Fraction *sumFraction(struct Fraction **x, unsigned int n) {
+    if (n == 0) {
+        return createFromBigIntsFraction(createBigInt(0), createBigInt(1), 1);
+    }
+
+    struct Fraction *out = sumOverLcmFraction(x, n);
+    reduceFraction(out);
+
+    return out;
+}
+
 struct Fraction *multiplyFraction(struct Fraction *x, struct Fraction *y) {
+    if (x == y) {
+        return squareFraction(x);
+    }
+
+    if (isIntegerFraction(x) && isIntegerFraction(y)) {
+        return createFromBigIntsFraction(multiplyBigInt(x->n, y->n), createBigInt(1), 1);
+    }
+
+    if (lazyFraction) {
+        struct Fraction *out = createFromBigIntsFraction(multiplyBigInt(x->n, y->n), multiplyBigInt(x->d, y->d), 0);
+        out->reducedBlocks = maxReducedBlocksFraction(x, y);
+        reduceIfLargeFraction(out);
+        return out;
+    }
+
+    reduceFraction(x);
+    reduceFraction(y);
+
     struct BigInt *a = gcdBigInt(x->n, y->d);
     struct BigInt *b = gcdBigInt(x->d, y->n);
     struct BigInt *gcd = multiplyBigInt(a, b);
@@ -188,11 +382,25 @@ struct Fraction *multiplyFraction(struct Fraction *x, struct Fraction *y) {
 
     freeBigInt(gcd);
  
-    struct Fraction *out = malloc(sizeof(struct Fraction));
-    out->n = a;
-    out->d = b;
-
+    struct Fraction *out = createFromBigIntsFraction(a, b, 0);
     correctSignFraction(out);
+    out->reduced = 1;
+    out->reducedBlocks = sizeFraction(out);
+
+    return out;
+}
+
+struct Fraction *squareFraction(struct Fraction *x) {
+    if (!lazyFraction) {
+        reduceFraction(x);
+    }
+
+    // If x is in simplest form, gcd(n^2, d^2) = 1 and there's nothing to cancel
+    struct Fraction *out = createFromBigIntsFraction(squareBigInt(x->n), squareBigInt(x->d), x->reduced);
+    if (!x->reduced) {
+        out->reducedBlocks = 2 * x->reducedBlocks;
+        reduceIfLargeFraction(out);
+    }
 
     return out;
 }
@@ -206,6 +414,7 @@ struct Fraction *divideFraction(struct Fraction *x, struct Fraction *y) {
 }
 
 struct Fraction *exponentFraction(struct Fraction *x, struct Fraction *y) {
+    reduceFraction(y);
     assert(y->n->sign == 1); // Positive
     assert(y->d->numBlocksUsed == 1 && y->d->blocks[0] == 1); // Denominator is 1
 
@@ -213,20 +422,15 @@ struct Fraction *exponentFraction(struct Fraction *x, struct Fraction *y) {
     struct Fraction *out = createFromStringFraction("1", "1");
     struct Fraction *z = copyFraction(x);
 
-    struct BigIntDigitPair *pair;
-
     while (!isZeroBigInt(n)) {
-        pair = divideByDigitBigInt(n, 2);
-        replaceBigInt(&n, pair->x);
-
-        if (pair->y == 1) {
+        if (n->blocks[0] & 1) {
             replaceFraction(&out, multiplyFraction(out, z));
         }
 
-        free(pair);
+        replaceBigInt(&n, shiftRightBitsBigInt(n, 1));
 
         if (!isZeroBigInt(n)) {
-            replaceFraction(&z, multiplyFraction(z, z));
+            replaceFraction(&z, squareFraction(z));
         }
     }
 
@@ -236,34 +440,192 @@ struct Fraction *exponentFraction(struct Fraction *x, struct Fraction *y) {
     return out;
 }
 
-struct Fraction *factorialFraction(struct Fraction *x) {
+// Returns x, which must be a non-negative integer that fits in one block
+static uint32_t toSmallIntegerFraction(struct Fraction *x) {
+    reduceFraction(x);
     assert(x->n->sign == 1); // Positive
     assert(x->n->numBlocksUsed == 1); // Can't handle taking factorial of large numbers
     assert(x->d->numBlocksUsed == 1 && x->d->blocks[0] == 1); // Denominator is 1
 
-    struct BigInt *n = createBigInt(1);
-    struct BigInt *mult = createBigInt(0);
+    return x->n->blocks[0];
+}
 
-    for (uint32_t i = 1; i <= x->n->blocks[0]; i++) {
-        mult->blocks[0] = i;
-        replaceBigInt(&n, multiplyBigInt(n, mult));
-    }
+// Returns n/1, taking ownership of n
+static struct Fraction *createFromIntegerFraction(struct BigInt *n) {
+    return createFromBigIntsFraction(n, createBigInt(1), 1);
+}
 
-    freeBigInt(mult);
+struct Fraction *factorialFraction(struct Fraction *x) {
+    return createFromIntegerFraction(factorialBigInt(toSmallIntegerFraction(x)));
+}
 
-    struct Fraction *out = malloc(sizeof(struct Fraction));
-    out->n = n;
-    out->d = createBigInt(1);
+// x (x - 1) ... (x - y + 1)
+struct Fraction *fallingFactorialFraction(struct Fraction *x, struct Fraction *y) {
+    return createFromIntegerFraction(fallingFactorialBigInt(toSmallIntegerFraction(x), toSmallIntegerFraction(y)));
+}
 
+// x choose y
+struct Fraction *binomialFraction(struct Fraction *x, struct Fraction *y) {
+    return createFromIntegerFraction(binomialBigInt(toSmallIntegerFraction(x), toSmallIntegerFraction(y)));
+}
+
+// (x[0] + ... + x[m - 1])! / (x[0]! ... x[m - 1]!)
+struct Fraction *multinomialFraction(struct Fraction **x, unsigned int m) {
+    uint32_t *k = malloc((m > 0 ? m : 1) * sizeof(uint32_t));
+    for (unsigned int i = 0; i < m; i++) {
+        k[i] = toSmallIntegerFraction(x[i]);
+    }
+
+    struct Fraction *out = createFromIntegerFraction(multinomialBigInt(k, m));
+    free(k);
     return out;
 }
 
 void printFraction(struct Fraction *f) {
+    reduceFraction(f);
     printBigIntDecimal(f->n);
     printf("/");
     printBigIntDecimal(f->d);
 }
 
+// Binary format: the numerator then the denominator, each in BigInt's binary
+// format. Fractions are written in simplest form, but input may come from
+// elsewhere, so they're reduced again when read
+
+size_t serializedSizeFraction(struct Fraction *x) {
+    reduceFraction(x);
+    return serializedSizeBigInt(x->n) + serializedSizeBigInt(x->d);
+}
+
+// Writes x to buffer, which must have room for serializedSizeFraction(x) bytes
+// Returns the number of bytes written
+size_t serializeFraction(struct Fraction *x, unsigned char *buffer) {
+    reduceFraction(x);
+    size_t used = serializeBigInt(x->n, buffer);
+    return used + serializeBigInt(x->d, buffer + used);
+}
+
+// Takes ownership of n and d, returns NULL if either is missing or the
+// denominator isn't positive, otherwise n/d in lowest terms
+static struct Fraction *createFromPartsFraction(struct BigInt *n, struct BigInt *d) {
+    if (n == NULL || d == NULL || d->sign == -1 || isZeroBigInt(d)) {
+        if (n != NULL) {
+            freeBigInt(n);
+        }
+        if (d != NULL) {
+            freeBigInt(d);
+        }
+        return NULL;
+    }
+
+    struct Fraction *out = createFromBigIntsFraction(n, d, 0);
+    reduceFraction(out);
+    return out;
+}
+
+// Reads a Fraction from the first size bytes of buffer, and sets *used (if
+// not NULL) to the number of bytes it took up
+// Returns NULL if the buffer is truncated or doesn't hold a valid Fraction
+struct Fraction *deserializeFraction(unsigned char *buffer, size_t size, size_t *used) {
+    size_t nUsed = 0;
+    size_t dUsed = 0;
+    struct BigInt *n = deserializeBigInt(buffer, size, &nUsed);
+    struct BigInt *d = n == NULL ? NULL : deserializeBigInt(buffer + nUsed, size - nUsed, &dUsed);
+
+    struct Fraction *out = createFromPartsFraction(n, d);
+    if (out != NULL && used != NULL) {
+        *used = nUsed + dUsed;
+    }
+    return out;
+}
+
+// Returns 1 if x was written to file, 0 on a write error
+int writeFraction(struct Fraction *x, FILE *file) {
+    reduceFraction(x);
+    return writeBigInt(x->n, file) && writeBigInt(x->d, file);
+}
+
+// Returns NULL at end of file, or if the input doesn't hold a valid Fraction
+struct Fraction *readFraction(FILE *file) {
+    struct BigInt *n = readBigInt(file);
+    struct BigInt *d = n == NULL ? NULL : readBigInt(file);
+    return createFromPartsFraction(n, d);
+}
+
+// Hex text looks like 0x1f/0x3 (or just 0x1f for integers), and is reduced
+// to simplest form when read, like the decimal text
+
+struct Fraction *createFromHexStringFraction(char *str) {
+    char *saveptr; // for strtok_r
+    char *nStr = strtok_r(str, "/", &saveptr);
+    char *dStr = strtok_r(NULL, "/", &saveptr);
+
+    assert(nStr != NULL);
+    assert(strtok_r(NULL, "/", &saveptr) == NULL); // No more tokens
+
+    struct BigInt *n = createFromHexStringBigInt(nStr);
+    struct BigInt *d = dStr == NULL ? createBigInt(1) : createFromHexStringBigInt(dStr);
+    struct Fraction *out = createFraction(n, d);
+    freeBigInt(n);
+    freeBigInt(d);
+    return out;
+}
+
+// Returns x in hex as a newly allocated string, which the caller frees
+char *toHexStringFraction(struct Fraction *x) {
+    reduceFraction(x);
+    char *n = toHexStringBigInt(x->n);
+    char *d = toHexStringBigInt(x->d);
+
+    size_t nLen = strlen(n);
+    char *out = malloc(nLen + strlen(d) + 2);
+    strcpy(out, n);
+    out[nLen] = '/';
+    strcpy(out + nLen + 1, d);
+
+    free(n);
+    free(d);
+    return out;
+}
+
+// Returns 1 if x was written to file, 0 on a write error
+int writeHexFraction(struct Fraction *x, FILE *file) {
+    reduceFraction(x);
+    return writeHexBigInt(x->n, file) && fputc('/', file) != EOF && writeHexBigInt(x->d, file);
+}
+
+// Returns NULL at end of file or if there's no number to read
+struct Fraction *readHexFraction(FILE *file) {
+    struct BigInt *n = readHexBigInt(file);
+    if (n == NULL) {
+        return NULL;
+    }
+
+    struct BigInt *d;
+    int c = fgetc(file);
+    if (c == '/') {
+        d = readHexBigInt(file);
+    } else {
+        if (c != EOF) {
+            ungetc(c, file);
+        }
+        d = createBigInt(1);
+    }
+
+    if (d == NULL || isZeroBigInt(d)) {
+        freeBigInt(n);
+        if (d != NULL) {
+            freeBigInt(d);
+        }
+        return NULL;
+    }
+
+    struct Fraction *out = createFraction(n, d);
+    freeBigInt(n);
+    freeBigInt(d);
+    return out;
+}
+
 /*
 int main (int argc, char** argv) {
 //    struct Fraction *f = createFromStringFraction("-479001600", "1048576");
@@ -277,6 +639,20 @@ int main (int argc, char** argv) {
     replaceFraction(&f, subtractFraction(f, f1));
     printFraction(f); printf("\n");
 
+    // Binary input that isn't in lowest terms (4 then 2) reads back as 2/1
+    struct BigInt *n = createBigInt(4);
+    struct BigInt *d = createBigInt(2);
+    unsigned char buffer[64];
+    size_t size = serializeBigInt(n, buffer);
+    size += serializeBigInt(d, buffer + size);
+    struct Fraction *f2 = deserializeFraction(buffer, size, NULL);
+    printFraction(f2); printf("\n");
+    replaceFraction(&f2, addFraction(f2, f2));
+    printFraction(f2); printf("\n");
+    freeFraction(f2);
+    freeBigInt(n);
+    freeBigInt(d);
+
 //    struct BigInt *a = createBigInt(1);
 //    struct BigInt *b = createBigInt(0);
 //    for (int i = 1; i < 10001; i++) {
@@ -3,9 +3,15 @@
 
 #include "bigint.h"
 
+// reduced is set when n/d is known to be in lowest terms, which is always
+// the case outside lazy mode (see setLazyFraction). reducedBlocks is the size
+// of n and d in blocks when it last was, or for a lazy result, the size of its
+// operands when they last were
 struct Fraction {
     struct BigInt *n;
     struct BigInt *d;
+    int reduced;
+    unsigned int reducedBlocks;
 };
 
 struct Fraction *createFraction(struct BigInt *n, struct BigInt *d);
@@ -15,15 +21,35 @@ struct Fraction *copyFraction(struct Fraction *x);
 void freeFraction(struct Fraction *f);
 void replaceFraction (struct Fraction **x, struct Fraction *y);
 
+void setLazyFraction(int lazy);
+int getLazyFraction();
+void reduceFraction(struct Fraction *x);
+int isIntegerFraction(struct Fraction *x);
+
 // All operations assume that fractions are in simplest form
 void correctSignFraction(struct Fraction *x);
 struct Fraction *invertFraction(struct Fraction *x);
 struct Fraction *addFraction(struct Fraction *x, struct Fraction *y);
 struct Fraction *subtractFraction(struct Fraction *x, struct Fraction *y);
+struct Fraction *sumFraction(struct Fraction **x, unsigned int n);
 struct Fraction *multiplyFraction(struct Fraction *x, struct Fraction *y);
+struct Fraction *squareFraction(struct Fraction *x);
 struct Fraction *divideFraction(struct Fraction *x, struct Fraction *y);
 struct Fraction *exponentFraction(struct Fraction *x, struct Fraction *y);
 struct Fraction *factorialFraction(struct Fraction *x);
+struct Fraction *fallingFactorialFraction(struct Fraction *x, struct Fraction *y);
+struct Fraction *binomialFraction(struct Fraction *x, struct Fraction *y);
+struct Fraction *multinomialFraction(struct Fraction **x, unsigned int m);
 void printFraction(struct Fraction *f);
 
+size_t serializedSizeFraction(struct Fraction *x);
+size_t serializeFraction(struct Fraction *x, unsigned char *buffer);
+struct Fraction *deserializeFraction(unsigned char *buffer, size_t size, size_t *used);
+int writeFraction(struct Fraction *x, FILE *file);
+struct Fraction *readFraction(FILE *file);
+struct Fraction *createFromHexStringFraction(char *str);
+char *toHexStringFraction(struct Fraction *x);
+int writeHexFraction(struct Fraction *x, FILE *file);
+struct Fraction *readHexFraction(FILE *file);
+
 #endif
@@ -0,0 +1,17 @@
+import random, sys
+random.seed(int(sys.argv[1])); N=int(sys.argv[2])
+def coef(bits, den, zero):
+    if random.random()<zero: return "0"
+    n=random.randint(-(1<<bits),1<<bits)
+    if den and random.random()<0.5:
+        d=random.randint(1,(1<<den)); return f"{n}/{d}"
+    return str(n)
+for _ in range(N):
+    for _ in range(2):
+        L=random.choice([1,2,3,5,17,40,200,1100,1500])
+        bits=random.choice([1,8,60,200,380,1000])
+        den=random.choice([0,0,4,40])
+        zero=random.choice([0,0.5,0.95,0.999])
+        c=[coef(bits,den,zero) for _ in range(L)]
+        if random.random()<0.7: c[-1]=str(random.randint(1,9))
+        print(" ".join(c))
@@ -29,7 +29,16 @@ struct Fraction *popFractionStack(struct FractionStack **stack) {
     return out;
 }
 
+// Temporaries created while evaluating an expression come from this arena,
+// which is reset once the result has been copied out of it
+static struct BigIntArena *exprArena = NULL;
+
 struct Fraction *evalExpr(char *expr, struct Fraction *lastResult) {
+    if (exprArena == NULL) {
+        exprArena = createArenaBigInt();
+    }
+    enterArenaBigInt(exprArena);
+
     char *saveptr; // for strtok_r
     char *token = strtok_r(expr, " ", &saveptr);
     struct FractionStack *stack = NULL;
@@ -58,11 +67,27 @@ struct Fraction *evalExpr(char *expr, struct Fraction *lastResult) {
             freeFraction(temp1);
             freeFraction(temp2);
         } else if (strcmp(token, "+") == 0) {
-            temp2 = popFractionStack(&stack);
-            temp1 = popFractionStack(&stack);
-            pushFractionStack(&stack, addFraction(temp1, temp2));
-            freeFraction(temp1);
-            freeFraction(temp2);
+            // A run of k pluses adds up the top k + 1 values, which
+            // sumFraction does with a single reduction
+            unsigned int k = 1;
+            char *next = strtok_r(NULL, " ", &saveptr);
+            while (next != NULL && strcmp(next, "+") == 0) {
+                k++;
+                next = strtok_r(NULL, " ", &saveptr);
+            }
+
+            struct Fraction **terms = malloc((k + 1) * sizeof(struct Fraction *));
+            for (unsigned int i = k + 1; i > 0; i--) {
+                terms[i - 1] = popFractionStack(&stack);
+            }
+            pushFractionStack(&stack, sumFraction(terms, k + 1));
+            for (unsigned int i = 0; i <= k; i++) {
+                freeFraction(terms[i]);
+            }
+            free(terms);
+
+            token = next;
+            continue;
         } else if (strcmp(token, "-") == 0) {
             // Order of pops is important
             temp2 = popFractionStack(&stack);
@@ -74,6 +99,36 @@ struct Fraction *evalExpr(char *expr, struct Fraction *lastResult) {
             temp1 = popFractionStack(&stack);
             pushFractionStack(&stack, factorialFraction(temp1));
             freeFraction(temp1);
+        } else if (strcmp(token, "C") == 0) {
+            // Order of pops is important
+            temp2 = popFractionStack(&stack);
+            temp1 = popFractionStack(&stack);
+            pushFractionStack(&stack, binomialFraction(temp1, temp2));
+            freeFraction(temp1);
+            freeFraction(temp2);
+        } else if (strcmp(token, "P") == 0) {
+            // Order of pops is important
+            temp2 = popFractionStack(&stack);
+            temp1 = popFractionStack(&stack);
+            pushFractionStack(&stack, fallingFactorialFraction(temp1, temp2));
+            freeFraction(temp1);
+            freeFraction(temp2);
+        } else if (strcmp(token, "M") == 0) {
+            // Takes everything on the stack
+            unsigned int m = 0;
+            for (struct FractionStack *cur = stack; cur != NULL; cur = cur->next) {
+                m++;
+            }
+
+            struct Fraction **parts = malloc((m > 0 ? m : 1) * sizeof(struct Fraction *));
+            for (unsigned int i = m; i > 0; i--) {
+                parts[i - 1] = popFractionStack(&stack);
+            }
+            pushFractionStack(&stack, multinomialFraction(parts, m));
+            for (unsigned int i = 0; i < m; i++) {
+                freeFraction(parts[i]);
+            }
+            free(parts);
         } else if (strcmp(token, "%") == 0) {
             pushFractionStack(&stack, copyFraction(lastResult));
         } else if (strcmp(token, "quit") == 0) {
@@ -90,7 +145,17 @@ struct Fraction *evalExpr(char *expr, struct Fraction *lastResult) {
     assert(stack == NULL);
 
     printFraction(temp1); printf("\n");
-    return temp1;
+
+    // Copy the result to the regular allocator, then free it inside the arena
+    // (which hands back any large blocks it passed on) and reclaim the rest
+    leaveArenaBigInt(exprArena);
+    temp2 = copyFraction(temp1);
+    enterArenaBigInt(exprArena);
+    freeFraction(temp1);
+    leaveArenaBigInt(exprArena);
+    resetArenaBigInt(exprArena);
+
+    return temp2;
 }
 
 int main (int argc, char** argv) {
@@ -105,11 +170,14 @@ int main (int argc, char** argv) {
     printf("***                     1000 ! 99 ! /\n");
     printf("***                     1 2 / 2 14 ^ ^\n");
     printf("***                     -3/5 -11/7 +\n");
+    printf("***                     100 50 C\n");
     printf("*** Rules:\n");
     printf("*** - enter expressions in postfix (i.e. Reverse Polish Notation)\n");
     printf("*** - all tokens should be separated by a single space\n");
     printf("*** - binary operators: +, -, *, /, and ^ (basic arithmetic)\n");
     printf("*** - unary operators: ! (takes factorial)\n");
+    printf("*** - combinatorics: n k C (n choose k), n k P (n!/(n-k)!),\n");
+    printf("***   and M (multinomial coefficient of everything on the stack)\n");
     printf("*** - fraction literals look like p/q, negatives like -x\n");
     printf("*** - use %% in place of an integer/fraction to access the result of the\n");
     printf("***   last expression to be evaluated\n");
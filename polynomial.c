@@ -94,11 +94,13 @@ struct Polynomial *zipPolynomial(
 ) {
     unsigned int maxCoeffs = x->numCoeffs > y->numCoeffs ? x->numCoeffs : y->numCoeffs;
     struct Polynomial *out = createPolynomial();
+    struct Fraction *zero = createFromStringFraction("0", "1");
 
     struct Fraction *coeff;
     for (unsigned int i = 0; i < maxCoeffs; i++) {
         if (i >= x->numCoeffs) {
-            coeff = copyFraction(y->coeffs[i]);
+            // Not just a copy, as func may be subtraction
+            coeff = (*func)(zero, y->coeffs[i]);
         } else if (i >= y->numCoeffs) {
             coeff = copyFraction(x->coeffs[i]);
         } else {
@@ -113,6 +115,7 @@ struct Polynomial *zipPolynomial(
         }
     }
 
+    freeFraction(zero);
     return out;
 }
 
@@ -124,25 +127,986 @@ struct Polynomial *subtractPolynomial(struct Polynomial *x, struct Polynomial *y
     return zipPolynomial(x, y, &subtractFraction);
 }
 
+// Products where the shorter operand has fewer than this many coefficients
+// are multiplied term by term, longer ones by Karatsuba
+#ifndef POLYNOMIAL_KARATSUBA_THRESHOLD
+#define POLYNOMIAL_KARATSUBA_THRESHOLD 16
+#endif
+
+// Products where both operands have at least this many coefficients are
+// done by Kronecker substitution, as long as the packed product takes at most
+// POLYNOMIAL_KRONECKER_MAX_BLOCKS blocks (a very large lcm of the
+// denominators could make it huge)
+#ifndef POLYNOMIAL_KRONECKER_THRESHOLD
+#define POLYNOMIAL_KRONECKER_THRESHOLD 4
+#endif
+
+#ifndef POLYNOMIAL_KRONECKER_MAX_BLOCKS
+#define POLYNOMIAL_KRONECKER_MAX_BLOCKS (1u << 26)
+#endif
+
+// Products where both operands have at least this many coefficients, of at
+// most POLYNOMIAL_MULTIMODULAR_MAX_BITS bits (after clearing denominators),
+// are done by multi-modular NTT instead. Reducing every coefficient modulo
+// every prime and putting them back together is quadratic in their size, so
+// Kronecker substitution wins again for bigger coefficients
+#ifndef POLYNOMIAL_MULTIMODULAR_THRESHOLD
+#define POLYNOMIAL_MULTIMODULAR_THRESHOLD 1024
+#endif
+
+#ifndef POLYNOMIAL_MULTIMODULAR_MAX_BITS
+#define POLYNOMIAL_MULTIMODULAR_MAX_BITS 384
+#endif
+
+// Products where the operands have at most this many pairs of nonzero terms
+// for each coefficient of the product are done term by term on the nonzero
+// terms only (see heapMultiplyTerms)
+#ifndef POLYNOMIAL_SPARSE_RATIO
+#define POLYNOMIAL_SPARSE_RATIO 4
+#endif
+
+// Coefficient arrays below are plain arrays of Fractions, lowest degree first
+
+static void freeCoeffs(struct Fraction **x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        freeFraction(x[i]);
+    }
+    free(x);
+}
+
+// out[i] += x[i] for i < n
+static void addToCoeffs(struct Fraction **out, struct Fraction **x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        replaceFraction(&out[i], addFraction(out[i], x[i]));
+    }
+}
+
+// out[i] -= x[i] for i < n
+static void subtractFromCoeffs(struct Fraction **out, struct Fraction **x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        replaceFraction(&out[i], subtractFraction(out[i], x[i]));
+    }
+}
+
+// Returns a new array holding x[0..xn) + y[0..yn), which has max(xn, yn)
+// coefficients
+static struct Fraction **sumCoeffs(struct Fraction **x, unsigned int xn, struct Fraction **y, unsigned int yn) {
+    unsigned int n = xn > yn ? xn : yn;
+    struct Fraction **out = malloc(n * sizeof(struct Fraction*));
+    for (unsigned int i = 0; i < n; i++) {
+        if (i >= xn) {
+            out[i] = copyFraction(y[i]);
+        } else if (i >= yn) {
+            out[i] = copyFraction(x[i]);
+        } else {
+            out[i] = addFraction(x[i], y[i]);
+        }
+    }
+    return out;
+}
+
+// Writes the xn + yn - 1 coefficients of x * y to out, as new Fractions
+// Each coefficient is summed in one go by sumFraction, rather than one
+// addFraction (and reduction) per term
+static void schoolbookMultiplyCoeffs(
+    struct Fraction **out,
+    struct Fraction **x, unsigned int xn,
+    struct Fraction **y, unsigned int yn
+) {
+    unsigned int maxTerms = xn < yn ? xn : yn;
+    struct Fraction **terms = malloc(maxTerms * sizeof(struct Fraction*));
+
+    for (unsigned int k = 0; k < xn + yn - 1; k++) {
+        unsigned int numTerms = 0;
+        unsigned int iStart = k >= yn ? k - yn + 1 : 0;
+        for (unsigned int i = iStart; i < xn && i <= k; i++) {
+            if (!isZeroBigInt(x[i]->n) && !isZeroBigInt(y[k - i]->n)) {
+                terms[numTerms++] = multiplyFraction(x[i], y[k - i]);
+            }
+        }
+
+        out[k] = sumFraction(terms, numTerms);
+        for (unsigned int t = 0; t < numTerms; t++) {
+            freeFraction(terms[t]);
+        }
+    }
+
+    free(terms);
+}
+
+// Writes the xn + yn - 1 coefficients of x * y to out, as new Fractions
+// With x = x0 + x1 t^m and y = y0 + y1 t^m, x y is z0 + z1 t^m + z2 t^2m for
+// z0 = x0 y0, z2 = x1 y1 and z1 = (x0 + x1)(y0 + y1) - z0 - z2, which takes
+// three half-size products instead of four
+static void karatsubaMultiplyCoeffs(
+    struct Fraction **out,
+    struct Fraction **x, unsigned int xn,
+    struct Fraction **y, unsigned int yn
+) {
+    if (xn < yn) {
+        struct Fraction **temp = x; x = y; y = temp;
+        unsigned int tempN = xn; xn = yn; yn = tempN;
+    }
+
+    if (yn < POLYNOMIAL_KARATSUBA_THRESHOLD) {
+        schoolbookMultiplyCoeffs(out, x, xn, y, yn);
+        return;
+    }
+
+    unsigned int m = (xn + 1) / 2;
+
+    if (yn <= m) {
+        // y has no high half, so x y = x0 y + x1 y t^m
+        karatsubaMultiplyCoeffs(out, x, m, y, yn);
+
+        unsigned int highN = xn - m + yn - 1;
+        struct Fraction **high = malloc(highN * sizeof(struct Fraction*));
+        karatsubaMultiplyCoeffs(high, x + m, xn - m, y, yn);
+
+        // The products overlap in yn - 1 coefficients
+        addToCoeffs(out + m, high, yn - 1);
+        for (unsigned int i = yn - 1; i < highN; i++) {
+            out[m + i] = high[i];
+        }
+        freeCoeffs(high, yn - 1);
+        return;
+    }
+
+    unsigned int z0n = 2 * m - 1;
+    unsigned int z2n = xn + yn - 2 * m - 1;
+
+    karatsubaMultiplyCoeffs(out, x, m, y, m);
+    out[z0n] = createFromStringFraction("0", "1");
+    karatsubaMultiplyCoeffs(out + 2 * m, x + m, xn - m, y + m, yn - m);
+
+    struct Fraction **xSum = sumCoeffs(x, m, x + m, xn - m);
+    struct Fraction **ySum = sumCoeffs(y, m, y + m, yn - m);
+    struct Fraction **z1 = malloc(z0n * sizeof(struct Fraction*));
+    karatsubaMultiplyCoeffs(z1, xSum, m, ySum, m);
+    freeCoeffs(xSum, m);
+    freeCoeffs(ySum, m);
+
+    subtractFromCoeffs(z1, out, z0n);
+    subtractFromCoeffs(z1, out + 2 * m, z2n);
+    addToCoeffs(out + m, z1, z0n);
+    freeCoeffs(z1, z0n);
+}
+
+// Returns the lcm of the denominators of x[0..n), and writes the numerators
+// over it (x[i] times the lcm) to out, as new BigInts
+static struct BigInt *clearDenominatorsCoeffs(struct Fraction **x, unsigned int n, struct BigInt **out) {
+    struct BigInt *lcm = createBigInt(1);
+    struct BigIntPair *pair;
+
+    for (unsigned int i = 0; i < n; i++) {
+        if (isIntegerFraction(x[i]) || compareBigInt(x[i]->d, lcm) == 0) {
+            continue;
+        }
+
+        struct BigInt *gcd = gcdBigInt(lcm, x[i]->d);
+        pair = divideBigInt(x[i]->d, gcd);
+        multiplyToBigInt(lcm, lcm, pair->x);
+        freeBigIntPair(pair);
+        freeBigInt(gcd);
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        if (compareBigInt(x[i]->d, lcm) == 0) {
+            out[i] = copyBigInt(x[i]->n);
+            continue;
+        }
+
+        pair = divideBigInt(lcm, x[i]->d);
+        out[i] = multiplyBigInt(x[i]->n, pair->x);
+        freeBigIntPair(pair);
+    }
+
+    return lcm;
+}
+
+static unsigned int maxBitLengthCoeffs(struct BigInt **x, unsigned int n) {
+    unsigned int out = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        unsigned int bits = bitLengthBigInt(x[i]);
+        out = bits > out ? bits : out;
+    }
+    return out;
+}
+
+static void freeBigIntCoeffs(struct BigInt **x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) {
+        freeBigInt(x[i]);
+    }
+    free(x);
+}
+
+// Writes the n = xn + yn - 1 coefficients of the integer polynomial x * y to
+// out, as new BigInts, by packing each operand into one BigInt with
+// Kronecker substitution and multiplying those, so the work goes to the fast
+// BigInt multiplication. The slots are bits wide, enough for any coefficient
+// of the product
+// Returns 0 (having written nothing) if the product would be too big
+static int kroneckerMultiplyBigIntCoeffs(
+    struct BigInt **out,
+    struct BigInt **x, unsigned int xn,
+    struct BigInt **y, unsigned int yn,
+    unsigned int bits
+) {
+    unsigned int n = xn + yn - 1;
+    unsigned int s = bits / 32 + 1;
+    if ((uint64_t)n * s > POLYNOMIAL_KRONECKER_MAX_BLOCKS) {
+        return 0;
+    }
+
+    struct BigInt *product = packSlotsBigInt(x, xn, s);
+    if (x == y && xn == yn) {
+        replaceBigInt(&product, squareBigInt(product));
+    } else {
+        struct BigInt *packed = packSlotsBigInt(y, yn, s);
+        replaceBigInt(&product, multiplyBigInt(product, packed));
+        freeBigInt(packed);
+    }
+
+    unpackSlotsBigInt(product, n, s, out);
+    freeBigInt(product);
+    return 1;
+}
+
+// Writes the xn + yn - 1 coefficients of the integer polynomial x * y to out,
+// as new BigInts, by Kronecker substitution, or, when the operands are long
+// and their coefficients not too big, by multi-modular NTT (see
+// convolveBigInt)
+// Returns 0 (having written nothing) if the product would be too big
+static int multiplyBigIntCoeffs(
+    struct BigInt **out,
+    struct BigInt **x, unsigned int xn,
+    struct BigInt **y, unsigned int yn
+) {
+    // |product coefficient| <= min(xn, yn) max|x| max|y|, plus a sign bit
+    unsigned int terms = xn < yn ? xn : yn;
+    unsigned int xBits = maxBitLengthCoeffs(x, xn);
+    unsigned int yBits = maxBitLengthCoeffs(y, yn);
+    unsigned int bits = xBits + yBits + 1;
+    while (terms > 1) {
+        bits++;
+        terms = (terms + 1) / 2;
+    }
+
+    if ((xn < yn ? xn : yn) >= POLYNOMIAL_MULTIMODULAR_THRESHOLD
+        && (xBits > yBits ? xBits : yBits) <= POLYNOMIAL_MULTIMODULAR_MAX_BITS
+        && convolveBigInt(out, x, xn, y, yn)) {
+        return 1;
+    }
+    return kroneckerMultiplyBigIntCoeffs(out, x, xn, y, yn, bits);
+}
+
+// Writes the xn + yn - 1 coefficients of x * y to out, as new Fractions
+// Both operands are scaled to integer polynomials (over the lcm of their
+// denominators) and multiplied by multiplyBigIntCoeffs. Each coefficient is
+// reduced once at the end
+// Returns 0 (having written nothing) if the product would be too big
+static int integerMultiplyCoeffs(
+    struct Fraction **out,
+    struct Fraction **x, unsigned int xn,
+    struct Fraction **y, unsigned int yn
+) {
+    unsigned int n = xn + yn - 1;
+    struct BigInt **xa = malloc(xn * sizeof(struct BigInt*));
+    struct BigInt *xd = clearDenominatorsCoeffs(x, xn, xa);
+    struct BigInt **ya = xa;
+    struct BigInt *yd = xd;
+    if (x != y || xn != yn) {
+        ya = malloc(yn * sizeof(struct BigInt*));
+        yd = clearDenominatorsCoeffs(y, yn, ya);
+    }
+
+    struct BigInt **c = malloc(n * sizeof(struct BigInt*));
+    int done = multiplyBigIntCoeffs(c, xa, xn, ya, yn);
+    if (done) {
+        struct BigInt *d = multiplyBigInt(xd, yd);
+        for (unsigned int k = 0; k < n; k++) {
+            out[k] = createFraction(c[k], d);
+            freeBigInt(c[k]);
+        }
+        freeBigInt(d);
+    }
+
+    free(c);
+    if (ya != xa) {
+        freeBigIntCoeffs(ya, yn);
+        freeBigInt(yd);
+    }
+    freeBigIntCoeffs(xa, xn);
+    freeBigInt(xd);
+    return done;
+}
+
+// A SparsePolynomial keeps only its nonzero terms, as exponents (in
+// increasing order) and their coefficients. Zero has no terms
+struct SparsePolynomial {
+    unsigned int numTerms;
+    unsigned int numTermsAllocated;
+    unsigned int *exponents;
+    struct Fraction **coeffs;
+};
+
+struct SparsePolynomial *createSparsePolynomial() {
+    struct SparsePolynomial *p = malloc(sizeof(struct SparsePolynomial));
+    p->numTerms = 0;
+    p->numTermsAllocated = 1;
+    p->exponents = malloc(sizeof(unsigned int));
+    p->coeffs = malloc(sizeof(struct Fraction*));
+
+    return p;
+}
+
+// Adds the term c * x^e (taking c) after x's last term, which must be of a
+// lower degree; zero coefficients are dropped
+static void appendTermSparsePolynomial(struct SparsePolynomial *x, unsigned int e, struct Fraction *c) {
+    assert(x->numTerms == 0 || x->exponents[x->numTerms - 1] < e);
+
+    if (isZeroBigInt(c->n)) {
+        freeFraction(c);
+        return;
+    }
+
+    if (x->numTerms == x->numTermsAllocated) {
+        x->numTermsAllocated *= 2;
+        x->exponents = realloc(x->exponents, x->numTermsAllocated * sizeof(unsigned int));
+        x->coeffs = realloc(x->coeffs, x->numTermsAllocated * sizeof(struct Fraction*));
+    }
+
+    x->exponents[x->numTerms] = e;
+    x->coeffs[x->numTerms] = c;
+    x->numTerms++;
+}
+
+void freeSparsePolynomial(struct SparsePolynomial *x) {
+    freeCoeffs(x->coeffs, x->numTerms);
+    free(x->exponents);
+    free(x);
+}
+
+void replaceSparsePolynomial(struct SparsePolynomial **x, struct SparsePolynomial *y) {
+    freeSparsePolynomial(*x);
+    *x = y;
+}
+
+// Whether a product with this many pairs of nonzero terms, and this many
+// coefficients, should be done term by term
+static int isSparseProduct(uint64_t pairs, unsigned int numCoeffs) {
+    return pairs <= (uint64_t)numCoeffs * POLYNOMIAL_SPARSE_RATIO;
+}
+
+struct HeapTerm {
+    uint64_t exponent;
+    unsigned int i;
+    unsigned int j;
+};
+
+static void pushHeapTerm(struct HeapTerm *heap, unsigned int *n, struct HeapTerm t) {
+    unsigned int k = (*n)++;
+    while (k > 0 && heap[(k - 1) / 2].exponent > t.exponent) {
+        heap[k] = heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    heap[k] = t;
+}
+
+static struct HeapTerm popHeapTerm(struct HeapTerm *heap, unsigned int *n) {
+    struct HeapTerm out = heap[0];
+    struct HeapTerm last = heap[--(*n)];
+
+    unsigned int k = 0;
+    while (2 * k + 1 < *n) {
+        unsigned int child = 2 * k + 1;
+        if (child + 1 < *n && heap[child + 1].exponent < heap[child].exponent) {
+            child++;
+        }
+        if (heap[child].exponent >= last.exponent) {
+            break;
+        }
+        heap[k] = heap[child];
+        k = child;
+    }
+    heap[k] = last;
+
+    return out;
+}
+
+// Multiplies the polynomials with nonzero terms xc[i] * x^xe[i] and
+// yc[j] * x^ye[j] (exponents increasing) term by term, producing the terms of
+// the product in order from a heap of candidates x_i * y_j (Johnson's
+// algorithm, adding x_(i+1) * y_0 and x_i * y_(j+1) only once x_i * y_j is
+// taken, as Monagan and Pearce do, so the heap never has more entries than x
+// has terms). Denominators are cleared first, so every product is accumulated
+// into one BigInt and each coefficient is reduced once
+static struct SparsePolynomial *heapMultiplyTerms(
+    unsigned int *xe, struct Fraction **xc, unsigned int xt,
+    unsigned int *ye, struct Fraction **yc, unsigned int yt
+) {
+    struct SparsePolynomial *out = createSparsePolynomial();
+    if (xt == 0 || yt == 0) {
+        return out;
+    }
+
+    // The heap holds at most one entry per term of x
+    if (xt > yt) {
+        unsigned int *te = xe;
+        struct Fraction **tc = xc;
+        unsigned int tt = xt;
+        xe = ye; xc = yc; xt = yt;
+        ye = te; yc = tc; yt = tt;
+    }
+
+    struct BigInt **xa = malloc(xt * sizeof(struct BigInt*));
+    struct BigInt *xd = clearDenominatorsCoeffs(xc, xt, xa);
+    struct BigInt **ya = xa;
+    struct BigInt *yd = xd;
+    if (xc != yc) {
+        ya = malloc(yt * sizeof(struct BigInt*));
+        yd = clearDenominatorsCoeffs(yc, yt, ya);
+    }
+    struct BigInt *d = multiplyBigInt(xd, yd);
+
+    struct HeapTerm *heap = malloc(xt * sizeof(struct HeapTerm));
+    unsigned int heapSize = 0;
+    pushHeapTerm(heap, &heapSize, (struct HeapTerm){(uint64_t)xe[0] + ye[0], 0, 0});
+
+    struct BigInt *sum = createBigInt(0);
+    while (heapSize > 0) {
+        struct HeapTerm t = popHeapTerm(heap, &heapSize);
+        multiplyAddBigInt(sum, xa[t.i], ya[t.j]);
+
+        if (t.j == 0 && t.i + 1 < xt) {
+            pushHeapTerm(heap, &heapSize, (struct HeapTerm){(uint64_t)xe[t.i + 1] + ye[0], t.i + 1, 0});
+        }
+        if (t.j + 1 < yt) {
+            pushHeapTerm(heap, &heapSize, (struct HeapTerm){(uint64_t)xe[t.i] + ye[t.j + 1], t.i, t.j + 1});
+        }
+
+        if (heapSize == 0 || heap[0].exponent != t.exponent) {
+            assert(t.exponent <= UINT32_MAX);
+            if (!isZeroBigInt(sum)) {
+                appendTermSparsePolynomial(out, t.exponent, createFraction(sum, d));
+                replaceBigInt(&sum, createBigInt(0));
+            }
+        }
+    }
+
+    freeBigInt(sum);
+    free(heap);
+    freeBigInt(d);
+    if (ya != xa) {
+        freeBigIntCoeffs(ya, yt);
+        freeBigInt(yd);
+    }
+    freeBigIntCoeffs(xa, xt);
+    freeBigInt(xd);
+    return out;
+}
+
+// Writes the exponents and coefficients (not copies) of x's nonzero terms to
+// e and c, returning how many there are
+static unsigned int nonzeroTermsPolynomial(struct Polynomial *x, unsigned int *e, struct Fraction **c) {
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < x->numCoeffs; i++) {
+        if (!isZeroBigInt(x->coeffs[i]->n)) {
+            e[n] = i;
+            c[n] = x->coeffs[i];
+            n++;
+        }
+    }
+    return n;
+}
+
+// Moves the terms of x into a new Polynomial, and frees x
+static struct Polynomial *fromTermsPolynomial(struct SparsePolynomial *x) {
+    struct Polynomial *out = createPolynomial();
+    if (x->numTerms > 0) {
+        ensureNumCoeffsPolynomial(out, x->exponents[x->numTerms - 1] + 1);
+    }
+    for (unsigned int i = 0; i < x->numTerms; i++) {
+        replaceFraction(&out->coeffs[x->exponents[i]], x->coeffs[i]);
+    }
+
+    free(x->exponents);
+    free(x->coeffs);
+    free(x);
+    return out;
+}
+
+// Products of mostly zero polynomials are done on their nonzero terms only
+// (heapMultiplyTerms). Others go through Kronecker substitution or
+// multi-modular NTT, unless an operand is very short or the packed numbers
+// would be too big, and then Karatsuba. Its intermediate sums are done in
+// lazy mode (see setLazyFraction), and each coefficient is reduced once at
+// the end
 struct Polynomial *multiplyPolynomial(struct Polynomial *x, struct Polynomial *y) {
+    unsigned int n = x->numCoeffs + y->numCoeffs - 1;
+
+    unsigned int *xe = malloc((x->numCoeffs + y->numCoeffs) * sizeof(unsigned int));
+    unsigned int *ye = xe + x->numCoeffs;
+    struct Fraction **xc = malloc((x->numCoeffs + y->numCoeffs) * sizeof(struct Fraction*));
+    struct Fraction **yc = xc + x->numCoeffs;
+    unsigned int xt = nonzeroTermsPolynomial(x, xe, xc);
+    unsigned int yt = x == y ? xt : nonzeroTermsPolynomial(y, ye, yc);
+    if (x == y) {
+        ye = xe;
+        yc = xc;
+    }
+    if (isSparseProduct((uint64_t)xt * yt, n)) {
+        struct SparsePolynomial *product = heapMultiplyTerms(xe, xc, xt, ye, yc, yt);
+        free(xe);
+        free(xc);
+        return fromTermsPolynomial(product);
+    }
+    free(xe);
+    free(xc);
+
+    struct Fraction **product = malloc(n * sizeof(struct Fraction*));
+
+    int lazy = getLazyFraction();
+    setLazyFraction(1);
+    unsigned int minCoeffs = x->numCoeffs < y->numCoeffs ? x->numCoeffs : y->numCoeffs;
+    if (minCoeffs < POLYNOMIAL_KRONECKER_THRESHOLD
+        || !integerMultiplyCoeffs(product, x->coeffs, x->numCoeffs, y->coeffs, y->numCoeffs)) {
+        karatsubaMultiplyCoeffs(product, x->coeffs, x->numCoeffs, y->coeffs, y->numCoeffs);
+    }
+    setLazyFraction(lazy);
+
     struct Polynomial *out = createPolynomial();
-    struct Fraction *coeff;
+    for (unsigned int k = 0; k < n; k++) {
+        if (!isZeroBigInt(product[k]->n)) {
+            if (!lazy) {
+                reduceFraction(product[k]);
+            }
+            ensureNumCoeffsPolynomial(out, k + 1);
+            replaceFraction(&out->coeffs[k], product[k]);
+        } else {
+            freeFraction(product[k]);
+        }
+    }
+
+    free(product);
+    return out;
+}
+
+// A DensePolynomial keeps its coefficients as integer numerators over one
+// common denominator, lowest degree first, with the numerators' blocks packed
+// one after the other in a single slab (so a pass over the coefficients walks
+// through memory in order). numerators is an array of BigInts whose blocks
+// point into that slab; they can be passed to any BigInt function that
+// doesn't resize or free its arguments
+// The form is canonical: the denominator is positive, it shares no factor
+// with all of the numerators, and the leading numerator is nonzero (unless
+// the polynomial is zero, which has one coefficient, 0, over 1)
+struct DensePolynomial {
+    unsigned int numCoeffs;
+    unsigned int numCoeffsAllocated;
+    struct BigInt *numerators;
+    struct BigInt *denominator;
+    size_t numBlocks;
+    size_t numBlocksAllocated;
+    uint32_t *blocks;
+};
+
+// Creates a DensePolynomial with no coefficients yet, over d (which it takes)
+// Coefficients are added with appendDensePolynomial, and finishDensePolynomial
+// puts it in canonical form
+static struct DensePolynomial *createEmptyDensePolynomial(struct BigInt *d, unsigned int numCoeffs, size_t numBlocks) {
+    struct DensePolynomial *x = malloc(sizeof(struct DensePolynomial));
+    x->numCoeffs = 0;
+    x->numCoeffsAllocated = numCoeffs > 0 ? numCoeffs : 1;
+    x->numerators = malloc(x->numCoeffsAllocated * sizeof(struct BigInt));
+    x->denominator = d;
+    x->numBlocks = 0;
+    x->numBlocksAllocated = numBlocks > 0 ? numBlocks : 1;
+    x->blocks = malloc(x->numBlocksAllocated * sizeof(uint32_t));
+
+    return x;
+}
+
+// Copies n to the end of x's numerators
+static void appendDensePolynomial(struct DensePolynomial *x, struct BigInt *n) {
+    if (x->numCoeffs == x->numCoeffsAllocated) {
+        x->numCoeffsAllocated *= 2;
+        x->numerators = realloc(x->numerators, x->numCoeffsAllocated * sizeof(struct BigInt));
+    }
+    if (x->numBlocks + n->numBlocksUsed > x->numBlocksAllocated) {
+        while (x->numBlocks + n->numBlocksUsed > x->numBlocksAllocated) {
+            x->numBlocksAllocated *= 2;
+        }
+        x->blocks = realloc(x->blocks, x->numBlocksAllocated * sizeof(uint32_t));
+    }
+
+    // blocks is filled in by finishDensePolynomial, as the slab may still move
+    struct BigInt *out = &x->numerators[x->numCoeffs];
+    out->sign = n->sign;
+    out->numBlocks = n->numBlocksUsed;
+    out->numBlocksUsed = n->numBlocksUsed;
+    out->blocks = NULL;
+    memcpy(x->blocks + x->numBlocks, n->blocks, n->numBlocksUsed * sizeof(uint32_t));
+
+    x->numCoeffs++;
+    x->numBlocks += n->numBlocksUsed;
+}
+
+// Points the numerators into the slab, drops leading zeros and divides out
+// any factor the denominator shares with all of the numerators
+static void finishDensePolynomial(struct DensePolynomial *x) {
+    uint32_t *blocks = x->blocks;
+    for (unsigned int i = 0; i < x->numCoeffs; i++) {
+        x->numerators[i].blocks = blocks;
+        blocks += x->numerators[i].numBlocks;
+    }
+
+    assert(x->numCoeffs > 0);
+    while (x->numCoeffs > 1 && isZeroBigInt(&x->numerators[x->numCoeffs - 1])) {
+        x->numCoeffs--;
+    }
+
+    struct BigInt *gcd = copyBigInt(x->denominator);
+    struct BigInt *one = createBigInt(1);
+    for (unsigned int i = 0; i < x->numCoeffs && compareBigInt(gcd, one) != 0; i++) {
+        if (!isZeroBigInt(&x->numerators[i])) {
+            replaceBigInt(&gcd, gcdBigInt(gcd, &x->numerators[i]));
+        }
+    }
+
+    // Quotients are no longer than the numerators, so they go back in place
+    if (compareBigInt(gcd, one) != 0) {
+        struct BigIntPair *pair = divideBigInt(x->denominator, gcd);
+        replaceBigInt(&x->denominator, pair->x);
+        pair->x = NULL;
+        freeBigInt(pair->y);
+        free(pair);
+
+        for (unsigned int i = 0; i < x->numCoeffs; i++) {
+            struct BigInt *n = &x->numerators[i];
+            pair = divideBigInt(n, gcd);
+            memcpy(n->blocks, pair->x->blocks, pair->x->numBlocksUsed * sizeof(uint32_t));
+            n->numBlocksUsed = pair->x->numBlocksUsed;
+            n->sign = pair->x->sign;
+            freeBigIntPair(pair);
+        }
+    }
+
+    freeBigInt(one);
+    freeBigInt(gcd);
+}
+
+void freeDensePolynomial(struct DensePolynomial *x) {
+    freeBigInt(x->denominator);
+    free(x->numerators);
+    free(x->blocks);
+    free(x);
+}
+
+void replaceDensePolynomial(struct DensePolynomial **x, struct DensePolynomial *y) {
+    freeDensePolynomial(*x);
+    *x = y;
+}
+
+// Creates a DensePolynomial from the n coefficients c over d (copying them)
+static struct DensePolynomial *createFromBigIntsDensePolynomial(struct BigInt **c, unsigned int n, struct BigInt *d) {
+    size_t numBlocks = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        numBlocks += c[i]->numBlocksUsed;
+    }
+
+    struct DensePolynomial *out = createEmptyDensePolynomial(copyBigInt(d), n, numBlocks);
+    for (unsigned int i = 0; i < n; i++) {
+        appendDensePolynomial(out, c[i]);
+    }
+    finishDensePolynomial(out);
+
+    return out;
+}
+
+struct DensePolynomial *toDensePolynomial(struct Polynomial *x) {
+    struct BigInt **c = malloc(x->numCoeffs * sizeof(struct BigInt*));
+    struct BigInt *d = clearDenominatorsCoeffs(x->coeffs, x->numCoeffs, c);
+    struct DensePolynomial *out = createFromBigIntsDensePolynomial(c, x->numCoeffs, d);
+
+    freeBigIntCoeffs(c, x->numCoeffs);
+    freeBigInt(d);
+    return out;
+}
+
+struct Polynomial *fromDensePolynomial(struct DensePolynomial *x) {
+    struct Polynomial *out = createPolynomial();
+    ensureNumCoeffsPolynomial(out, x->numCoeffs);
     for (unsigned int i = 0; i < x->numCoeffs; i++) {
-        for (unsigned int j = 0; j < y->numCoeffs; j++) {
-            coeff = multiplyFraction(x->coeffs[i], y->coeffs[j]);
+        if (!isZeroBigInt(&x->numerators[i])) {
+            replaceFraction(&out->coeffs[i], createFraction(&x->numerators[i], x->denominator));
+        }
+    }
+
+    return out;
+}
+
+// x + sign * y, with both brought over the lcm of their denominators
+static struct DensePolynomial *zipDensePolynomial(struct DensePolynomial *x, struct DensePolynomial *y, int sign) {
+    struct BigInt *gcd = gcdBigInt(x->denominator, y->denominator);
+    struct BigIntPair *xScale = divideBigInt(y->denominator, gcd);
+    struct BigIntPair *yScale = divideBigInt(x->denominator, gcd);
+    struct BigInt *d = multiplyBigInt(x->denominator, xScale->x);
+
+    unsigned int maxCoeffs = x->numCoeffs > y->numCoeffs ? x->numCoeffs : y->numCoeffs;
+    struct DensePolynomial *out = createEmptyDensePolynomial(
+        d, maxCoeffs, x->numBlocks + y->numBlocks + (size_t)maxCoeffs * (d->numBlocksUsed + 1)
+    );
 
-            if (!isZeroBigInt(coeff->n)) {
-                ensureNumCoeffsPolynomial(out, i + j + 1);
-                replaceFraction(&out->coeffs[i + j], addFraction(out->coeffs[i + j], coeff));
+    // Every coefficient goes through the same scratch BigInt on its way into
+    // the slab
+    struct BigInt *sum = createBigInt(0);
+    struct BigInt *zero = createBigInt(0);
+    for (unsigned int i = 0; i < maxCoeffs; i++) {
+        multiplyToBigInt(sum, i < x->numCoeffs ? &x->numerators[i] : zero, xScale->x);
+        if (i < y->numCoeffs) {
+            if (sign == 1) {
+                multiplyAddBigInt(sum, &y->numerators[i], yScale->x);
             } else {
-                freeFraction(coeff);
+                multiplySubtractBigInt(sum, &y->numerators[i], yScale->x);
             }
         }
+        appendDensePolynomial(out, sum);
+    }
+    finishDensePolynomial(out);
+
+    freeBigInt(zero);
+    freeBigInt(sum);
+    freeBigIntPair(xScale);
+    freeBigIntPair(yScale);
+    freeBigInt(gcd);
+    return out;
+}
+
+struct DensePolynomial *addDensePolynomial(struct DensePolynomial *x, struct DensePolynomial *y) {
+    return zipDensePolynomial(x, y, 1);
+}
+
+struct DensePolynomial *subtractDensePolynomial(struct DensePolynomial *x, struct DensePolynomial *y) {
+    return zipDensePolynomial(x, y, -1);
+}
+
+// The numerators are multiplied as integer polynomials (multiplyBigIntCoeffs,
+// or term by term if an operand is very short or the product very big)
+struct DensePolynomial *multiplyDensePolynomial(struct DensePolynomial *x, struct DensePolynomial *y) {
+    unsigned int n = x->numCoeffs + y->numCoeffs - 1;
+    struct BigInt **xn = malloc(x->numCoeffs * sizeof(struct BigInt*));
+    struct BigInt **yn = x == y ? xn : malloc(y->numCoeffs * sizeof(struct BigInt*));
+    for (unsigned int i = 0; i < x->numCoeffs; i++) {
+        xn[i] = &x->numerators[i];
+    }
+    for (unsigned int i = 0; i < y->numCoeffs; i++) {
+        yn[i] = &y->numerators[i];
+    }
+
+    struct BigInt **c = malloc(n * sizeof(struct BigInt*));
+    unsigned int minCoeffs = x->numCoeffs < y->numCoeffs ? x->numCoeffs : y->numCoeffs;
+    if (minCoeffs < POLYNOMIAL_KRONECKER_THRESHOLD
+        || !multiplyBigIntCoeffs(c, xn, x->numCoeffs, yn, y->numCoeffs)) {
+        for (unsigned int k = 0; k < n; k++) {
+            c[k] = createBigInt(0);
+        }
+        for (unsigned int i = 0; i < x->numCoeffs; i++) {
+            for (unsigned int j = 0; j < y->numCoeffs; j++) {
+                multiplyAddBigInt(c[i + j], xn[i], yn[j]);
+            }
+        }
+    }
+
+    struct BigInt *d = multiplyBigInt(x->denominator, y->denominator);
+    struct DensePolynomial *out = createFromBigIntsDensePolynomial(c, n, d);
+
+    freeBigInt(d);
+    freeBigIntCoeffs(c, n);
+    if (yn != xn) {
+        free(yn);
+    }
+    free(xn);
+    return out;
+}
+
+// Creates a SparsePolynomial from space-separated fractions, the coefficients
+// from lowest to highest degree as in createFromStringPolynomial, except that
+// zeros take no memory
+struct SparsePolynomial *createFromStringSparsePolynomial(char *strin) {
+    char *str = malloc((strlen(strin) + 1) * sizeof(char));
+    strcpy(str, strin);
+
+    struct SparsePolynomial *out = createSparsePolynomial();
+
+    char *saveptr; // for strtok_r
+    char *token = strtok_r(str, " ", &saveptr);
+    unsigned int i = 0;
+    while (token != NULL) {
+        appendTermSparsePolynomial(out, i, createFromSingleStringFraction(token));
+        token = strtok_r(NULL, " ", &saveptr);
+        i++;
+    }
+    free(str);
+
+    return out;
+}
+
+struct SparseTerm {
+    unsigned int exponent;
+    struct Fraction *coeff;
+};
+
+static int compareSparseTerms(const void *x, const void *y) {
+    unsigned int a = ((const struct SparseTerm*)x)->exponent;
+    unsigned int b = ((const struct SparseTerm*)y)->exponent;
+    return (a > b) - (a < b);
+}
+
+// Creates the SparsePolynomial with terms c[i] * x^e[i], in any order, adding
+// up terms of the same degree
+struct SparsePolynomial *createFromTermsSparsePolynomial(unsigned int *e, struct Fraction **c, unsigned int n) {
+    struct SparseTerm *terms = malloc((n > 0 ? n : 1) * sizeof(struct SparseTerm));
+    for (unsigned int i = 0; i < n; i++) {
+        terms[i].exponent = e[i];
+        terms[i].coeff = c[i];
+    }
+    qsort(terms, n, sizeof(struct SparseTerm), &compareSparseTerms);
+
+    struct SparsePolynomial *out = createSparsePolynomial();
+    unsigned int i = 0;
+    while (i < n) {
+        unsigned int j = i + 1;
+        while (j < n && terms[j].exponent == terms[i].exponent) {
+            j++;
+        }
+
+        struct Fraction **same = malloc((j - i) * sizeof(struct Fraction*));
+        for (unsigned int k = i; k < j; k++) {
+            same[k - i] = terms[k].coeff;
+        }
+        appendTermSparsePolynomial(out, terms[i].exponent, j - i == 1 ? copyFraction(same[0]) : sumFraction(same, j - i));
+        free(same);
+
+        i = j;
+    }
+
+    free(terms);
+    return out;
+}
+
+struct SparsePolynomial *toSparsePolynomial(struct Polynomial *x) {
+    struct SparsePolynomial *out = createSparsePolynomial();
+    for (unsigned int i = 0; i < x->numCoeffs; i++) {
+        if (!isZeroBigInt(x->coeffs[i]->n)) {
+            appendTermSparsePolynomial(out, i, copyFraction(x->coeffs[i]));
+        }
+    }
+
+    return out;
+}
+
+struct Polynomial *fromSparsePolynomial(struct SparsePolynomial *x) {
+    struct Polynomial *out = createPolynomial();
+    if (x->numTerms > 0) {
+        ensureNumCoeffsPolynomial(out, x->exponents[x->numTerms - 1] + 1);
+    }
+    for (unsigned int i = 0; i < x->numTerms; i++) {
+        replaceFraction(&out->coeffs[x->exponents[i]], copyFraction(x->coeffs[i]));
+    }
+
+    return out;
+}
+
+// Merges the terms of x and y, combining terms of the same degree with func
+// (so terms only in y go through it too, against zero)
+static struct SparsePolynomial *mergeSparsePolynomial(
+    struct SparsePolynomial *x,
+    struct SparsePolynomial *y,
+    struct Fraction *(*func)(struct Fraction*, struct Fraction*)
+) {
+    struct SparsePolynomial *out = createSparsePolynomial();
+    struct Fraction *zero = createFromStringFraction("0", "1");
+
+    unsigned int i = 0;
+    unsigned int j = 0;
+    while (i < x->numTerms || j < y->numTerms) {
+        if (j >= y->numTerms || (i < x->numTerms && x->exponents[i] < y->exponents[j])) {
+            appendTermSparsePolynomial(out, x->exponents[i], copyFraction(x->coeffs[i]));
+            i++;
+        } else if (i >= x->numTerms || y->exponents[j] < x->exponents[i]) {
+            appendTermSparsePolynomial(out, y->exponents[j], (*func)(zero, y->coeffs[j]));
+            j++;
+        } else {
+            appendTermSparsePolynomial(out, x->exponents[i], (*func)(x->coeffs[i], y->coeffs[j]));
+            i++;
+            j++;
+        }
+    }
+
+    freeFraction(zero);
+    return out;
+}
+
+struct SparsePolynomial *addSparsePolynomial(struct SparsePolynomial *x, struct SparsePolynomial *y) {
+    return mergeSparsePolynomial(x, y, &addFraction);
+}
+
+struct SparsePolynomial *subtractSparsePolynomial(struct SparsePolynomial *x, struct SparsePolynomial *y) {
+    return mergeSparsePolynomial(x, y, &subtractFraction);
+}
+
+// Products that are mostly zero are done on the terms (heapMultiplyTerms),
+// and others, with few enough gaps that they're worth filling in, by
+// multiplyPolynomial
+// Returns NULL if the product's degree would be over UINT32_MAX
+struct SparsePolynomial *multiplySparsePolynomial(struct SparsePolynomial *x, struct SparsePolynomial *y) {
+    if (x->numTerms == 0 || y->numTerms == 0) {
+        return createSparsePolynomial();
+    }
+
+    uint64_t degree = (uint64_t)x->exponents[x->numTerms - 1] + y->exponents[y->numTerms - 1];
+    if (degree > UINT32_MAX) {
+        return NULL;
+    }
+
+    // A degree of UINT32_MAX still fits, but only on the terms
+    uint64_t numCoeffs = degree + 1;
+    if (numCoeffs > UINT32_MAX || isSparseProduct((uint64_t)x->numTerms * y->numTerms, numCoeffs)) {
+        return heapMultiplyTerms(x->exponents, x->coeffs, x->numTerms, y->exponents, y->coeffs, y->numTerms);
+    }
+
+    struct Polynomial *dx = fromSparsePolynomial(x);
+    struct Polynomial *dy = y == x ? dx : fromSparsePolynomial(y);
+    struct Polynomial *product = multiplyPolynomial(dx, dy);
+    struct SparsePolynomial *out = toSparsePolynomial(product);
+
+    freePolynomial(product);
+    if (dy != dx) {
+        freePolynomial(dy);
     }
-    
+    freePolynomial(dx);
     return out;
 }
 
+void printSparsePolynomial(struct SparsePolynomial *x) {
+    if (x->numTerms == 0) {
+        printf("0");
+        return;
+    }
+
+    for (unsigned int i = x->numTerms; i > 0; i--) {
+        if (i < x->numTerms) {
+            printf(" + ");
+        }
+
+        printFraction(x->coeffs[i - 1]);
+        if (x->exponents[i - 1] > 0) {
+            printf(" * x^%u", x->exponents[i - 1]);
+        }
+    }
+}
+
 void printPolynomial(struct Polynomial *x) {
     unsigned int j;
     int firstTerm = 1;
@@ -177,6 +1141,12 @@ int main (int argc, char** argv) {
 
     freePolynomial(p);
 
+    struct SparsePolynomial *s = createFromStringSparsePolynomial("1 0 0 0 0 0 0 0 0 -2/3");
+    replaceSparsePolynomial(&s, multiplySparsePolynomial(s, s));
+    printSparsePolynomial(s); printf("\n");
+
+    freeSparsePolynomial(s);
+
 //    struct Polynomial *p = malloc(sizeof(struct Polynomial));
 //    p->numCoeffs = 1;
 //    p->numCoeffsAllocated = 1;